@@ -8,26 +8,28 @@
 #endif
 
 #include <ash/shell.hpp>
+#include <array>
 
 auto run_demo(ash::context ctx) -> ash::cmd_task
 {
+    using namespace std::literals;
+    using ash::net::buffer;
+
     co_await ctx.write("Insert a line of raw text: ");
     auto line = co_await ctx.read_line();
-    co_await ctx.write("You typed in '" + std::string(line) + "'\n");
+    co_await ctx.write(std::array{buffer("You typed in '"sv), buffer(line), buffer("'\n"sv)});
 
     co_await ctx.write("Insert a line of text to be tokenized: ");
     auto tks = co_await ctx.read_tokenized();
 
-    auto msg = "Your raw text '" + std::string(tks.value().raw_input) + "'\n"
-               + " which gets tokenized to:\n";
-    for (auto & tk : tks.value().tokens)
-    msg += " - '" + std::string(tk) + "'\n";
-    co_await ctx.write(msg);
+    co_await ctx.write(std::array{buffer("Your raw text '"sv), buffer(tks.value().raw_input),
+                                  buffer("'\n which gets tokenized to:\n"sv)});
+    for (auto tk : tks.value().tokens)
+        co_await ctx.write(std::array{buffer(" - '"sv), buffer(tk), buffer("'\n"sv)});
 
     co_await ctx.write("Insert a multi-line text with terminator 'EOI':\n");
     auto ml = co_await ctx.read_multiline("EOI");
-    msg = "You wrote '" + std::string(ml) + "'\n";
-    co_await ctx.write(msg);
+    co_await ctx.write(std::array{buffer("You wrote '"sv), buffer(ml), buffer("'\n"sv)});
 
     co_await ctx.write("Insert a multi-line text with a predicate (first char == end char):\n");
     ml = co_await ctx.read_multiline(
@@ -35,8 +37,7 @@ auto run_demo(ash::context ctx) -> ash::cmd_task
             {
                 return sv.front() == sv.back();
             });
-    msg = "You wrote '" + std::string(ml) + "'\n";
-    co_await ctx.write(msg);
+    co_await ctx.write(std::array{buffer("You wrote '"sv), buffer(ml), buffer("'\n"sv)});
 }
 
 int main(int argc, char * argv[])
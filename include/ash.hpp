@@ -1,9 +1,15 @@
 #ifndef ASH_ASH_H
 #define ASH_ASH_H
 
+#include <ash/buffer.hpp>
+#include <ash/command.hpp>
 #include <ash/config.hpp>
+#include <ash/framer.hpp>
+#include <ash/pool.hpp>
 #include <ash/reader.hpp>
+#include <ash/server.hpp>
 #include <ash/shell.hpp>
+#include <ash/structural.hpp>
 #include <ash/tokenizer.hpp>
 
 #endif //ASH_ASH_H
@@ -0,0 +1,123 @@
+#ifndef ASH_BUFFER_HPP
+#define ASH_BUFFER_HPP
+
+#include <algorithm>
+#include <cstring>
+#include <memory>
+#include <span>
+#include <string_view>
+#include <vector>
+#include <ash/pool.hpp>
+
+namespace ash
+{
+
+// Contiguous byte buffer with a read and a write cursor.
+// Consuming only moves the read cursor, bytes get moved to the front (or into a bigger block)
+// only when `prepare` cannot be satisfied by the free space at the end.
+// It's not a ring, because tokens need to be contiguous views.
+// A pinned region is never moved or overwritten; if it's in the way, the data goes into a new block
+// and the old one is kept alive until `unpin`.
+// The storage is borrowed from a buffer_pool and can be handed back with `release` once the buffer is drained.
+struct frame_buffer
+{
+    explicit frame_buffer(std::size_t capacity = 4096u, buffer_pool & pool = buffer_pool::default_pool())
+        : capacity_(capacity), initial_capacity_(capacity), pool_(&pool) {}
+
+    std::string_view data() const {return {storage_.get() + begin_, end_ - begin_};}
+    std::size_t size()      const {return end_ - begin_;}
+    bool empty()            const {return begin_ == end_;}
+    std::size_t capacity()  const {return capacity_;}
+
+    // get a writable region of n bytes at the end of the buffer.
+    std::span<char> prepare(std::size_t n)
+    {
+        const auto sz = size();
+        if (!storage_)
+        {
+            storage_ = pool_->acquire((std::max)(capacity_, n));
+            capacity_ = storage_.get_deleter().size;
+        }
+        else if (capacity_ - end_ < n)
+        {
+            if (capacity_ - sz >= n && !pinned())
+                std::memmove(storage_.get(), storage_.get() + begin_, sz);
+            else
+            {
+                auto new_storage = pool_->acquire((std::max)(capacity_ * 2u, sz + n));
+                std::memcpy(new_storage.get(), storage_.get() + begin_, sz);
+                if (pinned())
+                    retired_.push_back(std::move(storage_));
+                storage_ = std::move(new_storage);
+                capacity_ = storage_.get_deleter().size;
+                pin_ = npos;
+            }
+            begin_ = 0u;
+            end_ = sz;
+        }
+        return {storage_.get() + end_, n};
+    }
+
+    void commit(std::size_t n) {end_ += n;}
+
+    void consume(std::size_t n)
+    {
+        begin_ += n;
+        if (begin_ == end_ && !pinned())
+            begin_ = end_ = 0u;
+    }
+
+    // keep everything from data() + offset in place until `unpin`.
+    void pin(std::size_t offset)
+    {
+        if (!pinned())
+            pin_ = begin_ + offset;
+    }
+
+    void unpin()
+    {
+        pin_ = npos;
+        retired_.clear();
+        if (begin_ == end_)
+            begin_ = end_ = 0u;
+    }
+
+    bool pinned() const {return pin_ != npos;}
+
+    // give the storage back to the pool, if nothing in it is needed anymore.
+    bool release()
+    {
+        if (!empty() || pinned() || !storage_)
+            return false;
+        storage_.reset();
+        capacity_ = initial_capacity_;
+        begin_ = end_ = 0u;
+        return true;
+    }
+
+    void append(std::string_view data)
+    {
+        if (data.empty())
+            return;
+        auto buf = prepare(data.size());
+        std::memcpy(buf.data(), data.data(), data.size());
+        commit(data.size());
+    }
+
+  private:
+    constexpr static std::size_t npos = static_cast<std::size_t>(-1);
+
+    buffer_pool::block storage_;
+    std::size_t capacity_;
+    std::size_t initial_capacity_;
+    buffer_pool * pool_;
+    std::size_t begin_ = 0u;
+    std::size_t end_   = 0u;
+    std::size_t pin_   = npos;
+    // blocks that still hold pinned bytes.
+    std::vector<buffer_pool::block> retired_;
+};
+
+}
+
+#endif //ASH_BUFFER_HPP
@@ -0,0 +1,783 @@
+#ifndef ASH_COMMAND_HPP
+#define ASH_COMMAND_HPP
+
+#include <ash/config.hpp>
+#include <ash/pool.hpp>
+#include <ash/tokenizer.hpp>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <initializer_list>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace ash
+{
+
+// the frames of commands come from the frame_pool, so running a command doesn't allocate.
+template<typename Executor = net::any_io_executor>
+using basic_cmd_task = net::experimental::coro<void, void, Executor, frame_allocator<>>;
+
+template<typename Executor>
+struct basic_context;
+
+template<typename Executor>
+struct basic_shell;
+
+namespace detail
+{
+
+template<typename Func, typename Context, typename Task>
+concept async_cmd_handler = std::is_invocable_r_v<Task, Func&, Context>;
+
+// writes to ctx.output(), or returns what should be written.
+template<typename Func, typename Context, typename Task>
+concept sync_cmd_handler = !async_cmd_handler<Func, Context, Task> && std::is_invocable_v<Func&, Context&>
+        && (std::is_void_v<std::invoke_result_t<Func&, Context&>>
+            || std::is_convertible_v<std::invoke_result_t<Func&, Context&>, std::string_view>);
+
+// run a synchronous handler as a command, for callers that want a cmd_task.
+template<typename Task, typename Context, typename Handler>
+Task run_sync_cmd(Context ctx, const Handler & handler)
+{
+    handler.run_sync(ctx);
+    co_await ctx.write(std::string_view{});
+}
+
+}
+
+// What runs a command: a coroutine returning a cmd_task, or a synchronous function, e.g.
+//
+//     [](ash::context ctx) -> ash::cmd_task {co_await ctx.write("pong\n");}
+//     [](ash::context & ctx) {ctx.output() += "pong\n";}
+//     [](ash::context & ctx) {return std::string("pong\n");}
+//
+// The shell runs synchronous handlers inline & appends what they return to its output,
+// which saves the coroutine frame & the resumes for commands that never need to wait.
+template<typename Executor = net::any_io_executor>
+struct basic_cmd_handler
+{
+    using context_type = basic_context<Executor>;
+    using cmd_task = basic_cmd_task<Executor>;
+
+    basic_cmd_handler() = default;
+
+    template<typename Func>
+        requires detail::async_cmd_handler<Func, context_type, cmd_task>
+    basic_cmd_handler(Func func) : async_(std::move(func)) {}
+
+    template<typename Func>
+        requires detail::sync_cmd_handler<Func, context_type, cmd_task>
+    basic_cmd_handler(Func func)
+    {
+        if constexpr (std::is_void_v<std::invoke_result_t<Func&, context_type&>>)
+            sync_ = std::move(func);
+        else
+            sync_ = [func = std::move(func)](context_type & ctx) mutable {ctx.output() += std::string_view(func(ctx));};
+    }
+
+    explicit operator bool() const {return async_ || sync_;}
+    bool is_sync() const {return static_cast<bool>(sync_);}
+
+    cmd_task operator()(context_type ctx) const
+    {
+        if (sync_)
+            return detail::run_sync_cmd<cmd_task>(std::move(ctx), *this);
+        return async_(std::move(ctx));
+    }
+
+    // the output is queued, but not written.
+    void run_sync(context_type & ctx) const {sync_(ctx);}
+
+  private:
+    std::function<cmd_task(context_type)> async_;
+    std::function<void(context_type&)> sync_;
+};
+
+template<typename Executor = net::any_io_executor>
+struct basic_cmd
+{
+    using executor_type = Executor;
+    using context_type = basic_context<executor_type>;
+    using cmd_task = basic_cmd_task<executor_type>;
+
+    std::string name;
+    std::vector<std::string> aliases;
+
+    basic_cmd_handler<executor_type> run;
+    std::string help;
+    std::string description;
+
+    std::vector<basic_cmd<executor_type>> children;
+};
+
+template<typename Executor, typename Iterator>
+inline std::pair<const basic_cmd<Executor>*, std::size_t>
+    find_command(Iterator begin, Iterator end,
+                 const std::vector<basic_cmd<Executor>> & cmds,
+                 std::size_t depth = 0u)
+{
+    if (begin == end)
+        return {nullptr, depth};
+
+    auto nx = *begin;
+    auto cmd_itr = std::find_if(cmds.begin(), cmds.end(),
+                                [&](auto & c)
+                                {
+                                    return c.name == nx
+                                         || std::find(c.aliases.begin(), c.aliases.end(), nx) != c.aliases.end();
+                                });
+
+    if (cmd_itr != cmds.end())
+    {
+        //found a command, see if I can find a a nested one
+        auto nested = find_command(std::next(begin), end, cmd_itr->children, depth + 1);
+        if (nested.first)
+            return nested;
+        else
+            return {&*cmd_itr, depth + 1};
+    }
+    else
+        return {nullptr, depth};
+}
+
+// Maps the names & aliases of a command tree to the commands, with one hash map per level.
+// It points into the commands, so they need to outlive the index.
+template<typename Executor = net::any_io_executor>
+struct basic_command_index
+{
+    using cmd = basic_cmd<Executor>;
+
+    basic_command_index() = default;
+    explicit basic_command_index(const std::vector<cmd> & cmds)
+    {
+        add_level_(cmds);
+    }
+
+    // same as find_command, but one hash lookup per token.
+    template<typename Iterator>
+    std::pair<const cmd*, std::size_t> find(Iterator begin, Iterator end) const
+    {
+        const cmd * res = nullptr;
+        std::size_t depth = 0u;
+        for (auto level = levels_.empty() ? npos : 0u; level != npos && begin != end; begin++)
+        {
+            const auto & lv = levels_[level];
+            const auto itr = lv.find(std::string_view(*begin));
+            if (itr == lv.end())
+                break;
+            res = itr->second.command;
+            level = itr->second.children;
+            depth++;
+        }
+        return {res, depth};
+    }
+
+  private:
+    constexpr static std::size_t npos = static_cast<std::size_t>(-1);
+
+    struct string_hash
+    {
+        using is_transparent = void;
+        std::size_t operator()(std::string_view sv) const {return std::hash<std::string_view>{}(sv);}
+    };
+
+    struct entry
+    {
+        const cmd * command;
+        std::size_t children; // index of the level holding the subcommands
+    };
+
+    using level = std::unordered_map<std::string, entry, string_hash, std::equal_to<>>;
+
+    std::size_t add_level_(const std::vector<cmd> & cmds)
+    {
+        if (cmds.empty())
+            return npos;
+
+        const auto idx = levels_.size();
+        levels_.emplace_back();
+        for (const auto & c : cmds)
+        {
+            const entry e{&c, add_level_(c.children)};
+            // like find_command, the first command using a name wins.
+            levels_[idx].try_emplace(c.name, e);
+            for (const auto & a : c.aliases)
+                levels_[idx].try_emplace(a, e);
+        }
+        return idx;
+    }
+
+    std::vector<level> levels_;
+};
+
+namespace detail
+{
+
+constexpr std::string_view builtin_help = R"(
+root commands:
+    - help [cmds...]
+        print this help.
+    - exit
+        end this program)";
+
+constexpr std::string_view missing_help = "cannot find command help was requested for.\n";
+
+}
+
+// A type erased table of commands, so the shell can dispatch to a std::vector<cmd> or a static_command_table.
+template<typename Executor = net::any_io_executor>
+struct basic_command_lookup
+{
+    using context_type = basic_context<Executor>;
+    using cmd_task = basic_cmd_task<Executor>;
+    using iterator = token_list::iterator;
+
+    struct match
+    {
+        const void * command = nullptr;
+        cmd_task (*run)(const void * command, context_type ctx) = nullptr;
+        // set for synchronous handlers, which get run inline.
+        void (*run_sync)(const void * command, context_type & ctx) = nullptr;
+        // number of tokens naming the command.
+        std::size_t depth = 0u;
+
+        explicit operator bool() const {return command != nullptr;}
+        bool is_sync() const {return run_sync != nullptr;}
+        cmd_task operator()(context_type ctx) const {return run(command, std::move(ctx));}
+        void run_inline(context_type & ctx) const {run_sync(command, ctx);}
+    };
+
+    // a match for a command with a run member like basic_cmd_handler.
+    template<typename Cmd>
+    static match make_match(const Cmd * c, std::size_t depth)
+    {
+        match res{.command = c,
+                  .run = [](const void * c, context_type ctx) {return static_cast<const Cmd*>(c)->run(std::move(ctx));},
+                  .depth = depth};
+        if (c->run.is_sync())
+            res.run_sync = [](const void * c, context_type & ctx) {static_cast<const Cmd*>(c)->run.run_sync(ctx);};
+        return res;
+    }
+
+    const void * table = nullptr;
+    match (*find)(const void * table, iterator begin, iterator end) = nullptr;
+    // append the help for the command named by [begin, end), or the overview if it's empty.
+    void (*help)(const void * table, iterator begin, iterator end, std::string & out) = nullptr;
+};
+
+// Commands along with their index. Build it once & share it between sessions through a command_set, e.g.
+//
+//     auto registry = std::make_shared<const ash::command_registry>(std::move(cmds));
+//     ash::shell sh{reader, writer, registry};
+template<typename Executor = net::any_io_executor>
+struct basic_command_registry
+{
+    using cmd = basic_cmd<Executor>;
+    using lookup_type = basic_command_lookup<Executor>;
+    using iterator = typename lookup_type::iterator;
+
+    explicit basic_command_registry(std::vector<cmd> cmds = {}) : cmds_(std::move(cmds)), index_(cmds_) {}
+    // the index points into the commands, so it needs to be rebuilt.
+    basic_command_registry(const basic_command_registry & rhs) : basic_command_registry(rhs.cmds_) {}
+    basic_command_registry& operator=(const basic_command_registry & rhs) = delete;
+
+    const std::vector<cmd> & commands() const {return cmds_;}
+
+    template<typename Iterator>
+    std::pair<const cmd*, std::size_t> find(Iterator begin, Iterator end) const {return index_.find(begin, end);}
+
+    void help(iterator begin, iterator end, std::string & res) const
+    {
+        if (begin != end)
+        {
+            auto [cmd, depth] = find(begin, end);
+            if (!cmd)
+            {
+                res += detail::missing_help;
+                return;
+            }
+
+            res += cmd->help + "\n   " + cmd->description + "\n";
+            if (!cmd->children.empty())
+            {
+                res +=  "  subcommands:";
+                for (const auto & c : cmd->children)
+                {
+                    res += "\n    - " + c.name + "\n        " + c.help;
+                    if (!c.aliases.empty())
+                    {
+                        res += "\n      aliases:";
+                        for (const auto &a : c.aliases)
+                            res += "\n        - " + a;
+                    }
+                }
+            }
+            res += "\n";
+        }
+        else
+        {
+            res += detail::builtin_help;
+            for (const auto & c : cmds_)
+            {
+                res += "\n    - " + c.name + "\n        " + c.help;
+                if (!c.aliases.empty())
+                {
+                    res += "\n      aliases:";
+                    for (const auto &a : c.aliases)
+                        res += "\n        - " + a;
+                }
+            }
+            res += "\n";
+        }
+    }
+
+    // the registry needs to outlive the lookup.
+    lookup_type lookup() const
+    {
+        return {
+            .table = this,
+            .find = [](const void * table, iterator begin, iterator end) -> typename lookup_type::match
+            {
+                auto [c, depth] = static_cast<const basic_command_registry*>(table)->find(begin, end);
+                if (c == nullptr)
+                    return {};
+                return lookup_type::make_match(c, depth);
+            },
+            .help = [](const void * table, iterator begin, iterator end, std::string & out)
+            {
+                static_cast<const basic_command_registry*>(table)->help(begin, end, out);
+            }};
+    }
+
+  private:
+    std::vector<cmd> cmds_;
+    basic_command_index<Executor> index_;
+};
+
+// A registry that can change at runtime, e.g. when plugins get loaded.
+// Every change publishes a new immutable snapshot, which sessions pick up at the start of their next command.
+// Dispatch only reads the version counter; the lock guarding the snapshot only gets taken when it changed.
+// Old snapshots get freed once the last session drops them.
+template<typename Executor = net::any_io_executor>
+struct basic_command_publisher
+{
+    using cmd = basic_cmd<Executor>;
+    using registry_type = basic_command_registry<Executor>;
+    using snapshot_type = std::shared_ptr<const registry_type>;
+
+    explicit basic_command_publisher(std::vector<cmd> cmds = {})
+        : current_(std::make_shared<const registry_type>(std::move(cmds))) {}
+    basic_command_publisher(const basic_command_publisher &) = delete;
+    basic_command_publisher& operator=(const basic_command_publisher &) = delete;
+
+    // incremented after every publish.
+    std::uint64_t version() const {return version_.load(std::memory_order_acquire);}
+
+    snapshot_type snapshot() const
+    {
+        std::lock_guard<std::mutex> lock{snapshot_mutex_};
+        return current_;
+    }
+
+    // replace all commands.
+    void publish(std::vector<cmd> cmds)
+    {
+        auto next = std::make_shared<const registry_type>(std::move(cmds));
+        std::lock_guard<std::mutex> lock{update_mutex_};
+        publish_(std::move(next));
+    }
+
+    // change a copy of the current commands & publish it; updates don't get lost when they race.
+    template<typename Func>
+        requires std::invocable<Func&, std::vector<cmd>&>
+    void update(Func && func)
+    {
+        std::lock_guard<std::mutex> lock{update_mutex_};
+        auto cmds = snapshot()->commands();
+        func(cmds);
+        publish_(std::make_shared<const registry_type>(std::move(cmds)));
+    }
+
+    void add(cmd c)
+    {
+        update([&](std::vector<cmd> & cmds) {cmds.push_back(std::move(c));});
+    }
+
+    // remove the top level command, returns false if there isn't one.
+    bool remove(std::string_view name)
+    {
+        bool found = false;
+        update([&](std::vector<cmd> & cmds)
+               {
+                   found = std::erase_if(cmds, [&](const cmd & c) {return c.name == name;}) > 0u;
+               });
+        return found;
+    }
+
+  private:
+    void publish_(snapshot_type next)
+    {
+        {
+            std::lock_guard<std::mutex> lock{snapshot_mutex_};
+            std::swap(current_, next);
+        }
+        version_.fetch_add(1u, std::memory_order_release);
+        // the old snapshot gets freed here, unless a session still uses it.
+    }
+
+    // serializes the writers, which build the next snapshot while holding it.
+    std::mutex update_mutex_;
+    // only held to copy or swap the pointer.
+    mutable std::mutex snapshot_mutex_;
+    snapshot_type current_;
+    std::atomic<std::uint64_t> version_{0u};
+};
+
+// basic_cmd_handler for static commands; a function or a lambda without captures.
+template<typename Executor = net::any_io_executor>
+struct basic_static_cmd_handler
+{
+    using context_type = basic_context<Executor>;
+    using cmd_task = basic_cmd_task<Executor>;
+
+    constexpr basic_static_cmd_handler() = default;
+
+    template<typename Func>
+        requires std::is_convertible_v<Func, cmd_task(*)(context_type)>
+              || std::is_convertible_v<Func, void(*)(context_type&)>
+              || std::is_convertible_v<Func, std::string(*)(context_type&)>
+    constexpr basic_static_cmd_handler(Func func)
+    {
+        if constexpr (std::is_convertible_v<Func, cmd_task(*)(context_type)>)
+            async_ = func;
+        else if constexpr (std::is_convertible_v<Func, void(*)(context_type&)>)
+            sync_ = func;
+        else
+            sync_string_ = func;
+    }
+
+    constexpr explicit operator bool() const {return async_ || sync_ || sync_string_;}
+    constexpr bool is_sync() const {return sync_ != nullptr || sync_string_ != nullptr;}
+
+    cmd_task operator()(context_type ctx) const
+    {
+        if (is_sync())
+            return detail::run_sync_cmd<cmd_task>(std::move(ctx), *this);
+        return async_(std::move(ctx));
+    }
+
+    void run_sync(context_type & ctx) const
+    {
+        if (sync_)
+            sync_(ctx);
+        else
+            ctx.output() += sync_string_(ctx);
+    }
+
+  private:
+    cmd_task (*async_)(context_type) = nullptr;
+    void (*sync_)(context_type&) = nullptr;
+    std::string (*sync_string_)(context_type&) = nullptr;
+};
+
+// A command known at compile time, for static_command_table.
+template<typename Executor = net::any_io_executor>
+struct basic_static_cmd
+{
+    using executor_type = Executor;
+    using context_type = basic_context<executor_type>;
+    using cmd_task = basic_cmd_task<executor_type>;
+
+    std::string_view name;
+    basic_static_cmd_handler<executor_type> run;
+    std::string_view help;
+    std::string_view description;
+};
+
+namespace detail
+{
+
+constexpr std::uint64_t static_command_hash(std::uint64_t seed, std::string_view name)
+{
+    // fnv-1a
+    auto h = 14695981039346656037ull ^ seed;
+    for (auto c : name)
+    {
+        h ^= static_cast<unsigned char>(c);
+        h *= 1099511628211ull;
+    }
+    return h ^ (h >> 32u);
+}
+
+struct static_command_hash_params
+{
+    std::uint64_t seed;
+    std::size_t slots; // a power of two
+};
+
+template<const auto & Commands>
+consteval bool static_command_names_unique()
+{
+    for (std::size_t i = 0u; i < std::size(Commands); i++)
+        for (std::size_t j = i + 1u; j < std::size(Commands); j++)
+            if (Commands[i].name == Commands[j].name)
+                return false;
+    return true;
+}
+
+// find a seed that maps every name to a slot of its own.
+template<const auto & Commands>
+consteval static_command_hash_params find_static_command_hash()
+{
+    for (auto slots = std::bit_ceil((std::max)(std::size(Commands), std::size_t{1u})); ; slots *= 2u)
+        for (std::uint64_t seed = 0u; seed < 256u; seed++)
+        {
+            std::vector<bool> used(slots, false);
+            bool collision = false;
+            for (const auto & c : Commands)
+            {
+                const auto slot = static_command_hash(seed, c.name) & (slots - 1u);
+                collision = collision || used[slot];
+                used[slot] = true;
+            }
+            if (!collision)
+                return {seed, slots};
+        }
+}
+
+template<const auto & Commands>
+constexpr auto static_command_hash_v = find_static_command_hash<Commands>();
+
+// index + 1 of the command in each slot, 0 for empty slots.
+template<const auto & Commands>
+constexpr auto static_command_slots = []
+{
+    constexpr auto params = static_command_hash_v<Commands>;
+    std::array<std::uint32_t, params.slots> res{};
+    for (std::size_t i = 0u; i < std::size(Commands); i++)
+        res[static_command_hash(params.seed, Commands[i].name) & (params.slots - 1u)] = static_cast<std::uint32_t>(i + 1u);
+    return res;
+}();
+
+// the overview, followed by the help of each command; mark gets called at the end of each of them.
+template<const auto & Commands, typename Append, typename Mark>
+constexpr void static_command_help(Append && append, Mark && mark)
+{
+    append(builtin_help);
+    for (const auto & c : Commands)
+    {
+        append("\n    - ");
+        append(c.name);
+        append("\n        ");
+        append(c.help);
+    }
+    append("\n");
+    mark();
+    for (const auto & c : Commands)
+    {
+        append(c.help);
+        append("\n   ");
+        append(c.description);
+        append("\n\n");
+        mark();
+    }
+}
+
+template<const auto & Commands>
+constexpr auto static_command_help_text = []
+{
+    constexpr auto size = []
+    {
+        std::size_t n = 0u;
+        static_command_help<Commands>([&](std::string_view sv) {n += sv.size();}, []{});
+        return n;
+    }();
+    std::array<char, size> res{};
+    std::size_t pos = 0u;
+    static_command_help<Commands>([&](std::string_view sv)
+                                  {
+                                      for (auto c : sv)
+                                          res[pos++] = c;
+                                  }, []{});
+    return res;
+}();
+
+// where the overview & the help of each command end in static_command_help_text.
+template<const auto & Commands>
+constexpr auto static_command_help_offsets = []
+{
+    std::array<std::size_t, std::size(Commands) + 1u> res{};
+    std::size_t pos = 0u, idx = 0u;
+    static_command_help<Commands>([&](std::string_view sv) {pos += sv.size();},
+                                  [&] {res[idx++] = pos;});
+    return res;
+}();
+
+}
+
+// A table of commands known at compile time, with a perfect hash for dispatch and the help text built at compile time.
+// Commands need to be a constexpr array of basic_static_cmd with static storage, e.g.
+//
+//     constexpr static std::array commands{ash::static_cmd{.name = "reboot", .run = reboot, .help = "reboot the device"}};
+//     ash::shell sh{reader, writer, ash::static_command_table<commands>{}};
+//
+// Names need to be unique; there are no aliases or subcommands.
+template<const auto & Commands>
+struct static_command_table
+{
+    using cmd = typename std::remove_cvref_t<decltype(Commands)>::value_type;
+    using executor_type = typename cmd::executor_type;
+    using lookup_type = basic_command_lookup<executor_type>;
+    using iterator = typename lookup_type::iterator;
+
+    static_assert(detail::static_command_names_unique<Commands>(), "command names need to be unique");
+
+    constexpr static std::size_t size() {return std::size(Commands);}
+
+    constexpr static const cmd * find(std::string_view name)
+    {
+        constexpr auto params = detail::static_command_hash_v<Commands>;
+        const auto idx = detail::static_command_slots<Commands>[detail::static_command_hash(params.seed, name) & (params.slots - 1u)];
+        return idx != 0u && Commands[idx - 1u].name == name ? &Commands[idx - 1u] : nullptr;
+    }
+
+    // the overview of all commands.
+    constexpr static std::string_view help()
+    {
+        return {detail::static_command_help_text<Commands>.data(), detail::static_command_help_offsets<Commands>[0u]};
+    }
+
+    constexpr static std::string_view help(std::string_view name)
+    {
+        auto c = find(name);
+        if (c == nullptr)
+            return detail::missing_help;
+        const auto idx = static_cast<std::size_t>(c - std::data(Commands));
+        const auto & offsets = detail::static_command_help_offsets<Commands>;
+        return std::string_view{detail::static_command_help_text<Commands>.data(), offsets[idx + 1u]}.substr(offsets[idx]);
+    }
+
+    constexpr static lookup_type lookup()
+    {
+        return {
+            .table = nullptr,
+            .find = [](const void *, iterator begin, iterator end) -> typename lookup_type::match
+            {
+                if (begin == end)
+                    return {};
+                auto c = find(*begin);
+                if (c == nullptr)
+                    return {};
+                return lookup_type::make_match(c, 1u);
+            },
+            .help = [](const void *, iterator begin, iterator end, std::string & out)
+            {
+                out += begin == end ? help() : help(*begin);
+            }};
+    }
+};
+
+// What a shell dispatches to: a std::vector<cmd> (or a braced list of them), a shared registry,
+// a command_publisher or a static_command_table.
+// Copies share the registry, so a session costs the same no matter how many commands there are.
+template<typename Executor = net::any_io_executor>
+struct basic_command_set
+{
+    using cmd = basic_cmd<Executor>;
+    using registry_type = basic_command_registry<Executor>;
+    using publisher_type = basic_command_publisher<Executor>;
+    using lookup_type = basic_command_lookup<Executor>;
+    using iterator = typename lookup_type::iterator;
+
+    basic_command_set() = default;
+    basic_command_set(std::vector<cmd> cmds)
+        : basic_command_set(std::make_shared<const registry_type>(std::move(cmds))) {}
+    basic_command_set(std::initializer_list<cmd> cmds) : basic_command_set(std::vector<cmd>(cmds)) {}
+    basic_command_set(std::shared_ptr<const registry_type> registry)
+        : registry_(std::move(registry)), lookup_(registry_ ? registry_->lookup() : lookup_type{}) {}
+    basic_command_set(std::shared_ptr<publisher_type> publisher)
+        : publisher_(std::move(publisher))
+    {
+        refresh();
+    }
+
+    template<const auto & Commands>
+        requires std::same_as<typename static_command_table<Commands>::executor_type, Executor>
+    basic_command_set(static_command_table<Commands> table) : lookup_(table.lookup()) {}
+
+    typename lookup_type::match find(iterator begin, iterator end) const
+    {
+        if (lookup_.find == nullptr)
+            return {};
+        return lookup_.find(lookup_.table, begin, end);
+    }
+
+    void help(iterator begin, iterator end, std::string & out) const
+    {
+        if (lookup_.help == nullptr)
+            out.append(begin == end ? detail::builtin_help : detail::missing_help).append(begin == end ? "\n" : "");
+        else
+            lookup_.help(lookup_.table, begin, end, out);
+    }
+
+    // pick up the latest snapshot of the publisher, if there's a newer one.
+    // Matches found before stay valid until the next refresh.
+    void refresh()
+    {
+        if (publisher_ == nullptr)
+            return;
+        const auto version = publisher_->version();
+        if (registry_ != nullptr && version == version_)
+            return;
+        // the snapshot might already be newer than the version, which only causes another refresh.
+        registry_ = publisher_->snapshot();
+        version_ = version;
+        lookup_ = registry_->lookup();
+    }
+
+    // a set with a copy of the registry of its own, so it doesn't share the reference count with this one,
+    // e.g. for another core. Sets following a publisher keep following it.
+    basic_command_set clone() const
+    {
+        if (publisher_ != nullptr || registry_ == nullptr)
+            return *this;
+        return basic_command_set(std::make_shared<const registry_type>(*registry_));
+    }
+
+    // null for a static_command_table.
+    const std::shared_ptr<const registry_type> & registry() const {return registry_;}
+
+  private:
+    std::shared_ptr<const publisher_type> publisher_;
+    std::uint64_t version_ = 0u;
+    std::shared_ptr<const registry_type> registry_;
+    lookup_type lookup_;
+};
+
+using cmd_task          = basic_cmd_task<>;
+using cmd               = basic_cmd<>;
+using cmd_handler       = basic_cmd_handler<>;
+using command_index     = basic_command_index<>;
+using command_registry  = basic_command_registry<>;
+using command_publisher = basic_command_publisher<>;
+using command_lookup    = basic_command_lookup<>;
+using command_set       = basic_command_set<>;
+using static_cmd        = basic_static_cmd<>;
+
+}
+
+#endif //ASH_COMMAND_HPP
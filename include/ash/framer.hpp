@@ -0,0 +1,255 @@
+#ifndef ASH_FRAMER_HPP
+#define ASH_FRAMER_HPP
+
+#include <algorithm>
+#include <functional>
+#include <memory_resource>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <variant>
+#include <ash/buffer.hpp>
+#include <ash/tokenizer.hpp>
+
+namespace ash
+{
+
+struct reader_mode
+{
+    struct tokenize_t
+    {
+        tokenize_t() : resource(std::pmr::get_default_resource()) {}
+        tokenize_t(std::pmr::memory_resource * resource) : resource(resource) {}
+
+        // where the tokens of long lines get allocated.
+        std::pmr::memory_resource * resource;
+    };
+    struct raw_line_t {};
+    struct multiline_with_terminator_t {std::string_view terminator;};
+    struct multiline_with_predicate_t {std::function<bool(std::string_view)> predicate;};
+
+    std::variant<tokenize_t, raw_line_t, multiline_with_predicate_t, multiline_with_terminator_t> state;
+    // keep the line valid until the next pinned read, instead of only until the next resume.
+    bool pin = false;
+
+    reader_mode(tokenize_t val = {}) : state(std::move(val)) {}
+    reader_mode(raw_line_t val) : state(std::move(val)) {}
+    reader_mode(multiline_with_terminator_t val) : state(std::move(val)) {}
+    reader_mode(multiline_with_predicate_t val) : state(std::move(val)) {}
+
+    bool tokenize() {return holds_alternative<tokenize_t>(state);}
+    bool raw_line() {return holds_alternative<raw_line_t>(state);}
+    auto multiline_with_terminator() {return get_if<multiline_with_terminator_t>(&state);}
+    auto multiline_with_predicate()  {return get_if<multiline_with_predicate_t>(&state);}
+};
+
+// Cuts the incoming bytes into lines according to the reader_mode.
+// Chunks handed in through `feed` get framed in place, only an incomplete tail gets copied by `stash`.
+// Stream readers can use prepare & commit to read directly into the framer's storage.
+// A line (and its tokens) points into the framer and stays valid until the next call to next/feed/prepare;
+// a line read with `reader_mode::pin` stays valid until the next pinned read, so nested reads can't invalidate it.
+struct line_framer
+{
+    explicit line_framer(buffer_pool & pool = buffer_pool::default_pool()) : buffer_(4096u, pool) {}
+
+    // the chunk needs to stay valid until `stash` is called.
+    void feed(std::string_view chunk)
+    {
+        if (buffer_.empty())
+            chunk_ = chunk;
+        else
+            buffer_.append(chunk);
+    }
+
+    // copy the unconsumed part of the current chunk into the buffer, before the chunk gets invalidated.
+    void stash()
+    {
+        buffer_.append(chunk_);
+        chunk_ = {};
+    }
+
+    std::span<char> prepare(std::size_t n)
+    {
+        stash();
+        return buffer_.prepare(n);
+    }
+
+    void commit(std::size_t n) {buffer_.commit(n);}
+
+    // hand the storage back to the pool while there's nothing buffered, e.g. before waiting for an idle peer.
+    bool release()
+    {
+        if (!chunk_.empty())
+            return false;
+        // a copy of a pinned line that's done with doesn't keep its capacity around.
+        if (pinned_.empty())
+            std::string{}.swap(pinned_);
+        return buffer_.release();
+    }
+
+    std::string_view data() const {return chunk_.empty() ? buffer_.data() : chunk_;}
+    bool empty() const {return chunk_.empty() && buffer_.empty();}
+    // bytes the tokenizer went over, each only once as long as the framing stays linear.
+    std::size_t bytes_scanned() const {return bytes_scanned_;}
+
+    // whether next(mode) would hand out a line without more input. Doesn't consume anything & can't tell
+    // for the multiline modes, so these say no.
+    // A tokenized line gets scanned like next would do it, so next can hand it out without scanning it again.
+    bool has_line(const reader_mode & mode)
+    {
+        const auto msg = data();
+        if (holds_alternative<reader_mode::tokenize_t>(mode.state))
+        {
+            if (line_end_ == std::string_view::npos)
+                line_end_ = scan_(msg);
+            if (line_end_ == std::string_view::npos)
+                return false;
+            else if (line_end_ != tokenizer_.begin)
+                return true;
+
+            // an empty statement, which next skips; look past it without touching the state.
+            line_tokenizer tk;
+            for (auto ln = msg.substr(line_end_ + 1u); ;)
+            {
+                const auto end = tk.scan(ln, [](token_span) {});
+                if (end == std::string_view::npos)
+                    return false;
+                else if (end != tk.begin)
+                    return true;
+                ln.remove_prefix(end + 1u);
+                tk.reset();
+            }
+        }
+        else if (holds_alternative<reader_mode::raw_line_t>(mode.state))
+            return msg.find('\n') != std::string_view::npos;
+        else
+            return false;
+    }
+
+    std::optional<tokenized_view> next(reader_mode & mode)
+    {
+        if (mode.pin)
+        {
+            buffer_.unpin();
+            pinned_.clear();
+        }
+        const auto msg = data();
+        if (auto tk = get_if<reader_mode::tokenize_t>(&mode.state); tk != nullptr)
+        {
+            // skip empty statements, so the caller can tell "no complete line" by the nullopt.
+            for (auto ln = msg; ; ln = data())
+            {
+                const auto end = line_end_ != std::string_view::npos
+                               ? std::exchange(line_end_, std::string_view::npos)
+                               : scan_(ln);
+                if (end == std::string_view::npos)
+                    break;
+
+                // the offsets are relative to data(), which might have moved since the scan started.
+                tokenized_view res{.raw_input = ln.substr(tokenizer_.begin, end - tokenizer_.begin),
+                                   .tokens = token_list(tokens_, tk->resource)};
+                res.tokens.set_base(ln.data());
+                if (res.raw_input.empty())
+                    consume_(end + 1);
+                else
+                    return yield_(std::move(res), end + 1, mode.pin);
+            }
+        }
+        else if (mode.raw_line())
+        {
+            if (auto pos = msg.find('\n', scanned_); pos != std::string_view::npos)
+            {
+                return yield_(tokenized_view{.raw_input = msg.substr(0, pos), .tokens = {}}, pos + 1, mode.pin);
+            }
+            scanned_ = msg.size();
+        }
+        else if (auto mlp = mode.multiline_with_predicate(); mlp != nullptr)
+        {
+            // every line before scanned_ has already been rejected by the predicate
+            for (auto pos = msg.find('\n', scanned_); pos != std::string_view::npos; pos = msg.find('\n', pos + 1))
+            {
+                auto candidate = msg.substr(0, pos);
+                if (mlp->predicate(candidate))
+                    return yield_(tokenized_view{.raw_input = candidate, .tokens = {}}, pos + 1, mode.pin);
+            }
+            scanned_ = msg.size();
+        }
+        else if (auto mlt = mode.multiline_with_terminator(); mlt != nullptr)
+        {
+            // the first line ending with the terminator is the first occurrence of terminator + '\n'.
+            pattern_.assign(mlt->terminator);
+            pattern_ += '\n';
+            // back off, in case the pattern got split between two chunks.
+            const auto from = scanned_ >= pattern_.size() ? scanned_ - (pattern_.size() - 1u) : 0u;
+            const auto itr = std::search(msg.begin() + from, msg.end(),
+                                         std::boyer_moore_horspool_searcher(pattern_.begin(), pattern_.end()));
+            if (itr != msg.end())
+            {
+                const auto pos = static_cast<std::size_t>(itr - msg.begin()) + mlt->terminator.size();
+                return yield_(tokenized_view{.raw_input = msg.substr(0, pos), .tokens = {}}, pos + 1, mode.pin);
+            }
+            scanned_ = msg.size();
+        }
+        return std::nullopt;
+    }
+
+  private:
+    // continue the tokenized line.
+    std::size_t scan_(std::string_view ln)
+    {
+        const auto from = tokenizer_.position;
+        const auto end = tokenizer_.scan(ln, [this](token_span sp) {tokens_.push_back(sp.offset, sp.length, sp.kind);});
+        bytes_scanned_ += tokenizer_.position - from;
+        return end;
+    }
+
+    // the line ends before data() + n.
+    tokenized_view yield_(tokenized_view res, std::size_t n, bool pin)
+    {
+        if (pin && !chunk_.empty())
+        {
+            // the chunk belongs to the caller and dies with the next read, so the line needs a copy.
+            const auto offset = static_cast<std::size_t>(res.raw_input.data() - chunk_.data());
+            pinned_.assign(chunk_.data(), n);
+            res.raw_input = std::string_view{pinned_}.substr(offset, res.raw_input.size());
+            res.tokens.set_base(pinned_.data());
+        }
+        else if (pin)
+            buffer_.pin(0u);
+        consume_(n);
+        return res;
+    }
+
+    // only moves a cursor, so views into data() stay valid until the next feed/prepare.
+    void consume_(std::size_t n)
+    {
+        if (chunk_.empty())
+            buffer_.consume(n);
+        else
+            chunk_.remove_prefix(n);
+        tokenizer_.reset();
+        tokens_.clear();
+        line_end_ = std::string_view::npos;
+        scanned_ = 0u;
+    }
+
+    frame_buffer buffer_;
+    std::string_view chunk_;
+    // offsets are relative to data(), which only moves when a line gets consumed.
+    // the mode can only change after a line was handed out, so the state never belongs to another mode.
+    line_tokenizer tokenizer_;
+    token_list tokens_;
+    // the end of the line has_line found, so next doesn't scan it again.
+    std::size_t line_end_ = std::string_view::npos;
+    std::size_t bytes_scanned_ = 0u;
+    // how far the line based modes have looked for their end.
+    std::size_t scanned_ = 0u;
+    std::string pattern_;
+    // pinned line that came from a chunk.
+    std::string pinned_;
+};
+
+}
+
+#endif //ASH_FRAMER_HPP
@@ -0,0 +1,263 @@
+#ifndef ASH_POOL_HPP
+#define ASH_POOL_HPP
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+namespace ash
+{
+
+// Size-classed pool of read buffers, shared between sessions.
+// Classes are powers of two from 4 KiB to 512 KiB, bigger blocks bypass the pool.
+struct buffer_pool
+{
+    constexpr static std::size_t min_block_size = 4096u;
+    constexpr static std::size_t class_count    = 8u;
+    constexpr static std::size_t max_block_size = min_block_size << (class_count - 1u);
+
+    struct deleter
+    {
+        buffer_pool * pool = nullptr;
+        std::size_t size   = 0u;
+
+        void operator()(char * ptr) const {pool->release_(ptr, size);}
+    };
+    using block = std::unique_ptr<char[], deleter>;
+
+    // keep at most max_cached free blocks per class.
+    explicit buffer_pool(std::size_t max_cached = 64u) : max_cached_(max_cached) {}
+    buffer_pool(const buffer_pool &) = delete;
+    buffer_pool& operator=(const buffer_pool &) = delete;
+
+    ~buffer_pool()
+    {
+        for (auto & fl : free_)
+            for (auto ptr : fl)
+                delete [] ptr;
+    }
+
+    static buffer_pool & default_pool()
+    {
+        static buffer_pool pool;
+        return pool;
+    }
+
+    // the block holds at least n bytes, block.get_deleter().size tells how many.
+    block acquire(std::size_t n)
+    {
+        const auto sz = block_size(n);
+        if (sz <= max_block_size)
+        {
+            std::lock_guard<std::mutex> lock{mutex_};
+            auto & fl = free_[class_of_(sz)];
+            if (!fl.empty())
+            {
+                auto ptr = fl.back();
+                fl.pop_back();
+                return block{ptr, deleter{this, sz}};
+            }
+        }
+        return block{new char[sz], deleter{this, sz}};
+    }
+
+    // the size a request for n bytes gets rounded up to.
+    constexpr static std::size_t block_size(std::size_t n)
+    {
+        if (n <= min_block_size)
+            return min_block_size;
+        else if (n <= max_block_size)
+            return std::bit_ceil(n);
+        else
+            return n;
+    }
+
+    // bytes held by free blocks.
+    std::size_t cached() const
+    {
+        std::lock_guard<std::mutex> lock{mutex_};
+        std::size_t res = 0u;
+        for (std::size_t i = 0u; i < class_count; i++)
+            res += free_[i].size() * (min_block_size << i);
+        return res;
+    }
+
+  private:
+    constexpr static std::size_t class_of_(std::size_t sz)
+    {
+        return static_cast<std::size_t>(std::countr_zero(sz / min_block_size));
+    }
+
+    void release_(char * ptr, std::size_t sz)
+    {
+        if (sz <= max_block_size)
+        {
+            std::lock_guard<std::mutex> lock{mutex_};
+            auto & fl = free_[class_of_(sz)];
+            if (fl.size() < max_cached_)
+            {
+                fl.push_back(ptr);
+                return;
+            }
+        }
+        delete [] ptr;
+    }
+
+    std::size_t max_cached_;
+    mutable std::mutex mutex_;
+    std::array<std::vector<char*>, class_count> free_;
+};
+
+// Thread-local freelists for coroutine frames, in steps of 64 bytes up to 4 KiB; bigger frames bypass the pool.
+// The freelists are intrusive, so recycling a frame never allocates. A frame freed on another thread
+// goes to the freelist of that thread.
+struct frame_pool
+{
+    constexpr static std::size_t granularity    = 64u;
+    constexpr static std::size_t max_frame_size = 4096u;
+    constexpr static std::size_t class_count    = max_frame_size / granularity;
+    // free frames kept per class.
+    constexpr static std::size_t max_cached     = 256u;
+
+    struct stats_type
+    {
+        std::size_t allocations = 0u;
+        std::size_t reused      = 0u; // served from a freelist
+        std::size_t largest     = 0u;
+        // allocations per size class, the last one counts the frames that were too big.
+        std::array<std::size_t, class_count + 1u> sizes{};
+    };
+
+    frame_pool() = default;
+    frame_pool(const frame_pool &) = delete;
+    frame_pool& operator=(const frame_pool &) = delete;
+
+    ~frame_pool()
+    {
+        for (auto & fl : free_)
+            while (fl.head != nullptr)
+                ::operator delete(std::exchange(fl.head, fl.head->next));
+    }
+
+    // the pool of this thread, null if it's already gone, i.e. during thread exit.
+    static frame_pool * local();
+
+    void * allocate(std::size_t n)
+    {
+        stats_.allocations++;
+        stats_.largest = (std::max)(stats_.largest, n);
+        if (n == 0u || n > max_frame_size)
+        {
+            stats_.sizes.back()++;
+            return ::operator new(n);
+        }
+        const auto cls = class_of_(n);
+        stats_.sizes[cls]++;
+        auto & fl = free_[cls];
+        if (fl.head != nullptr)
+        {
+            stats_.reused++;
+            fl.size--;
+            return std::exchange(fl.head, fl.head->next);
+        }
+        return ::operator new(block_size(n));
+    }
+
+    void deallocate(void * ptr, std::size_t n) noexcept
+    {
+        if (n != 0u && n <= max_frame_size)
+        {
+            auto & fl = free_[class_of_(n)];
+            if (fl.size < max_cached)
+            {
+                fl.head = ::new (ptr) node{fl.head};
+                fl.size++;
+                return;
+            }
+        }
+        ::operator delete(ptr);
+    }
+
+    // the size of the block that gets allocated for n bytes; every block that can end up in a freelist needs to be that big.
+    constexpr static std::size_t block_size(std::size_t n)
+    {
+        return n == 0u || n > max_frame_size ? n : (class_of_(n) + 1u) * granularity;
+    }
+
+    const stats_type & stats() const {return stats_;}
+    void reset_stats() {stats_ = {};}
+
+  private:
+    struct node
+    {
+        node * next;
+    };
+    struct freelist
+    {
+        node * head = nullptr;
+        std::size_t size = 0u;
+    };
+
+    struct local_holder;
+
+    constexpr static std::size_t class_of_(std::size_t n) {return (n - 1u) / granularity;}
+
+    static inline thread_local bool local_destroyed_ = false;
+    std::array<freelist, class_count> free_;
+    stats_type stats_;
+};
+
+// only the thread's own pool marks itself as gone, others can come & go as they like.
+struct frame_pool::local_holder
+{
+    frame_pool pool;
+    ~local_holder() {local_destroyed_ = true;}
+};
+
+inline frame_pool * frame_pool::local()
+{
+    if (local_destroyed_)
+        return nullptr;
+    thread_local local_holder holder;
+    return &holder.pool;
+}
+
+// A stateless allocator for coroutine frames, that gets them from the frame_pool of the current thread.
+template<typename T = void>
+struct frame_allocator
+{
+    using value_type = T;
+
+    frame_allocator() = default;
+    template<typename U>
+    frame_allocator(const frame_allocator<U> &) noexcept {}
+
+    T * allocate(std::size_t n)
+    {
+        if (auto pool = frame_pool::local())
+            return static_cast<T*>(pool->allocate(n * sizeof(T)));
+        // it might get deallocated on a thread that still has its pool.
+        return static_cast<T*>(::operator new(frame_pool::block_size(n * sizeof(T))));
+    }
+
+    void deallocate(T * ptr, std::size_t n) noexcept
+    {
+        if (auto pool = frame_pool::local())
+            pool->deallocate(ptr, n * sizeof(T));
+        else
+            ::operator delete(ptr);
+    }
+
+    template<typename U>
+    bool operator==(const frame_allocator<U> &) const noexcept {return true;}
+};
+
+}
+
+#endif //ASH_POOL_HPP
@@ -1,10 +1,13 @@
 #ifndef ASH_READER_HPP
 #define ASH_READER_HPP
 
-#include <array>
+#include <algorithm>
 #include <string_view>
 #include <ash/config.hpp>
+#include <ash/framer.hpp>
+#include <ash/pool.hpp>
 #include <ash/tokenizer.hpp>
+#include <ash/uring.hpp>
 
 namespace ash
 {
@@ -17,17 +20,82 @@ using basic_chunk_writer = net::experimental::coro<std::size_t(std::string_view)
 using chunk_reader = basic_chunk_reader<>;
 using chunk_writer = basic_chunk_writer<>;
 
+struct read_stats
+{
+    std::size_t reads   = 0u;
+    std::size_t bytes   = 0u;
+    std::size_t grown   = 0u;
+    std::size_t shrunk  = 0u;
+    std::size_t largest = 0u; // the largest read size used
+};
+
+// Doubles the read size while reads fill the buffer, halves it when a read returns less than a quarter of it.
+struct read_size_policy
+{
+    read_size_policy(std::size_t min_size = buffer_pool::min_block_size, std::size_t max_size = 256u * 1024u)
+        : min_size(min_size), max_size((std::max)(min_size, max_size)), current_(min_size) {}
+
+    std::size_t min_size;
+    std::size_t max_size;
+    read_stats stats;
+
+    std::size_t size() const {return current_;}
+
+    void update(std::size_t requested, std::size_t read)
+    {
+        stats.reads++;
+        stats.bytes += read;
+        stats.largest = (std::max)(stats.largest, requested);
+
+        if (read == requested && current_ < max_size)
+        {
+            current_ = (std::min)(current_ * 2u, max_size);
+            stats.grown++;
+        }
+        else if (read < requested / 4u && current_ > min_size)
+        {
+            current_ = (std::max)(current_ / 2u, min_size);
+            stats.shrunk++;
+        }
+    }
+
+  private:
+    std::size_t current_;
+};
+
+struct read_options
+{
+    buffer_pool * pool = &buffer_pool::default_pool();
+    // owned by the caller, so it can look at the stats. Stream readers use a default policy if it's null.
+    read_size_policy * read_size = nullptr;
+    // wait for the stream to become readable before taking a buffer.
+    // Needs to be off for regular files, which can't be waited on.
+    bool wait_for_readiness = true;
+    // set before a line gets handed out, to whether the line after it is complete already,
+    // i.e. if the next read (in the same mode) won't have to wait for input.
+    bool * line_buffered = nullptr;
+};
+
+// waits for the stream to become readable before borrowing a buffer, so idle streams don't hold one.
 template<typename StreamType>
-auto stream_reader(StreamType stream) -> basic_chunk_reader<typename std::decay_t<StreamType>::executor_type>
+auto stream_reader(StreamType stream, read_options opts = {})
+    -> basic_chunk_reader<typename std::decay_t<StreamType>::executor_type>
 {
+    read_size_policy default_policy;
+    auto & policy = opts.read_size != nullptr ? *opts.read_size : default_policy;
     while (stream.is_open())
     {
-        std::array<char, 4096> buf;
-        auto read = co_await stream.async_read_some(net::buffer(buf), net::experimental::use_coro);
+        if (opts.wait_for_readiness)
+            co_await stream.async_wait(std::decay_t<StreamType>::wait_read, net::experimental::use_coro);
+        // returned to the pool after the consumer is done with the chunk, i.e. when we get resumed.
+        const auto size = policy.size();
+        auto buf = opts.pool->acquire(size);
+        auto read = co_await stream.async_read_some(net::buffer(buf.get(), size), net::experimental::use_coro);
+        policy.update(size, read);
         if (read == 0u)
             continue;
 
-        co_yield std::string_view{buf.data(), read};
+        co_yield std::string_view{buf.get(), read};
     }
 }
 
@@ -35,30 +103,86 @@ template<typename StreamType>
 auto stream_writer(StreamType stream, std::string_view msg = "") -> basic_chunk_writer<typename std::decay_t<StreamType>::executor_type>
 {
     while (stream.is_open())
-        msg = co_yield co_await async_write(stream, net::buffer(msg), net::experimental::use_coro);
+    {
+        // e.g. the message priming the writer; no need to bother the stream with that.
+        std::size_t written = 0u;
+        if (!msg.empty())
+            written = co_await async_write(stream, net::buffer(msg), net::experimental::use_coro);
+        msg = co_yield written;
+    }
 }
 
 
-struct reader_mode
+#if defined(ASH_HAS_IO_URING)
+
+// Reads with a multishot recv (or read, for other fds) from the ring's shared buffers.
+// The chunk stays valid until the reader gets resumed, then its buffer goes back to the kernel.
+// The stream's executor needs to be a strand, if its context is run by more than one thread.
+template<typename StreamType>
+auto uring_stream_reader(StreamType stream) -> basic_chunk_reader<typename std::decay_t<StreamType>::executor_type>
 {
-    struct tokenize_t {};
-    struct raw_line_t {};
-    struct multiline_with_terminator_t {std::string_view terminator;};
-    struct multiline_with_predicate_t {std::function<bool(std::string_view)> predicate;};
-
-    std::variant<tokenize_t, raw_line_t, multiline_with_predicate_t, multiline_with_terminator_t> state;
-
-    reader_mode(tokenize_t val = {}) : state(std::move(val)) {}
-    reader_mode(raw_line_t val) : state(std::move(val)) {}
-    reader_mode(multiline_with_terminator_t val) : state(std::move(val)) {}
-    reader_mode(multiline_with_predicate_t val) : state(std::move(val)) {}
-
-    bool tokenize() {return holds_alternative<tokenize_t>(state);}
-    bool raw_line() {return holds_alternative<raw_line_t>(state);}
-    auto multiline_with_terminator() {return get_if<multiline_with_terminator_t>(&state);}
-    auto multiline_with_predicate()  {return get_if<multiline_with_predicate_t>(&state);}
-};
+    auto & ring = uring_context::use(stream.get_executor());
+    auto op = ring.make_operation(stream.get_executor(), stream.native_handle());
+    // don't leave a multishot running on a stream that's about to be closed, nor its buffers in the channel.
+    struct close_on_exit
+    {
+        uring_context & ring;
+        std::shared_ptr<uring_operation> & op;
+        ~close_on_exit() {ring.close(op);}
+    } guard{ring, op};
+
+    while (stream.is_open())
+    {
+        if (!op->armed)
+            ring.read_multishot(op);
+        const auto cp = co_await op->completions.async_receive(net::experimental::use_coro);
+        op->armed = (cp.flags & IORING_CQE_F_MORE) != 0u;
+        if (cp.res == -ENOBUFS)
+        {
+            // all of the ring's buffers are in use, so read this one the regular way.
+            auto buf = buffer_pool::default_pool().acquire(buffer_pool::min_block_size);
+            auto read = co_await stream.async_read_some(net::buffer(buf.get(), buf.get_deleter().size),
+                                                        net::experimental::use_coro);
+            if (read > 0u)
+                co_yield std::string_view{buf.get(), read};
+            continue;
+        }
+        else if (cp.res < 0)
+            throw std::system_error(-cp.res, std::system_category());
+        else if (cp.res == 0)
+            break;
+
+        struct recycle_on_exit
+        {
+            uring_context & ring;
+            const uring_completion & cp;
+            ~recycle_on_exit() {ring.recycle(cp);}
+        } recycle{ring, cp};
+        co_yield ring.buffer(cp);
+    }
+}
 
+template<typename StreamType>
+auto uring_stream_writer(StreamType stream, std::string_view msg = "") -> basic_chunk_writer<typename std::decay_t<StreamType>::executor_type>
+{
+    auto & ring = uring_context::use(stream.get_executor());
+    auto op = ring.make_operation(stream.get_executor(), stream.native_handle());
+    while (stream.is_open())
+    {
+        std::size_t written = 0u;
+        while (written < msg.size())
+        {
+            ring.write(op, msg.substr(written));
+            const auto cp = co_await op->completions.async_receive(net::experimental::use_coro);
+            if (cp.res < 0)
+                throw std::system_error(-cp.res, std::system_category());
+            written += static_cast<std::size_t>(cp.res);
+        }
+        msg = co_yield written;
+    }
+}
+
+#endif
 
 template<typename Executor = net::any_io_executor>
 using basic_token_reader = net::experimental::coro<tokenized_view(reader_mode), void, Executor>;
@@ -66,80 +190,61 @@ using basic_token_reader = net::experimental::coro<tokenized_view(reader_mode),
 using token_reader = basic_token_reader<>;
 
 template<typename Executor = net::any_io_executor>
-basic_token_reader<Executor> read(basic_chunk_reader<Executor> reader, reader_mode mode = {})
+basic_token_reader<Executor> read(basic_chunk_reader<Executor> reader, reader_mode mode = {}, read_options opts = {})
 {
-    std::string buffer;
-    while (auto msg_ = co_await reader)
+    line_framer framer{*opts.pool};
+    while (true)
     {
-        auto msg = *msg_;
-        if (!buffer.empty())
+        // hand out everything that's already buffered before waiting for more input.
+        while (auto ln = framer.next(mode))
         {
-            buffer.insert(buffer.end(), msg.begin(), msg.end());
-            msg = buffer;
+            if (opts.line_buffered != nullptr)
+                *opts.line_buffered = framer.has_line(mode);
+            mode = co_yield std::move(*ln);
         }
 
-        if (mode.tokenize())
-        {
-            auto [d, rest_line] = pick_line(msg);
-            if (d.empty())
-            {
-                buffer.assign(rest_line.begin(), rest_line.end());
-                continue;
-            }
-            auto [res, rest] = tokenize(d);
-            buffer.assign(rest.begin(), rest.end());
-            buffer += rest_line;
-            mode = co_yield res;
-        }
-        else if (mode.raw_line())
-        {
-            if (auto pos = msg.find('\n'); pos != std::string_view::npos)
-            {
-                mode = co_yield {.raw_input = msg.substr(0, pos)};
-                buffer.assign(msg.substr(pos));
-            }
-            else
-                buffer.insert(buffer.end(), msg.begin(), msg.end());
-        }
-        else if (auto mlp = mode.multiline_with_predicate(); mlp != nullptr)
+        framer.stash();
+        framer.release();
+        auto msg = co_await reader;
+        if (!msg)
+            break;
+        framer.feed(*msg);
+    }
+}
+
+// read directly into the framer's storage, so complete lines don't get copied at all.
+// The storage is only borrowed from the pool while there's something to read or buffered.
+// Lines need to be contiguous, so this is a single read into the free end of the storage, not a readv.
+template<typename StreamType>
+    requires requires (std::decay_t<StreamType> & stream) {stream.is_open();}
+auto read(StreamType stream, reader_mode mode = {}, read_options opts = {})
+    -> basic_token_reader<typename std::decay_t<StreamType>::executor_type>
+{
+    read_size_policy default_policy;
+    auto & policy = opts.read_size != nullptr ? *opts.read_size : default_policy;
+    line_framer framer{*opts.pool};
+    while (stream.is_open())
+    {
+        while (auto ln = framer.next(mode))
         {
-            bool found = false;
-            for (auto pos = msg.find('\n'); pos != std::string_view::npos; pos = msg.find('\n', pos + 1))
-            {
-                auto candidate = msg.substr(0, pos);
-                if (mlp->predicate(candidate))
-                {
-                    mode = co_yield {.raw_input = candidate};
-                    buffer.assign(msg.substr(pos + 1));
-                    found = true;
-                    break;
-                }
-            }
-            if (!found)
-                buffer.assign(msg.begin(), msg.end());
+            if (opts.line_buffered != nullptr)
+                *opts.line_buffered = framer.has_line(mode);
+            mode = co_yield std::move(*ln);
         }
-        else if (auto mlt = mode.multiline_with_terminator(); mlt != nullptr)
+
+        if (opts.wait_for_readiness)
         {
-            bool found = false;
-            for (auto pos = msg.find('\n'); pos != std::string_view::npos; pos = msg.find('\n', pos + 1))
-            {
-                auto candidate = msg.substr(0, pos);
-                if (candidate.ends_with(mlt->terminator))
-                {
-                    mode = co_yield {.raw_input = candidate};
-                    buffer.assign(msg.substr(pos + 1));
-                    found = true;
-                    break;
-                }
-            }
-            if (!found)
-                buffer.assign(msg.begin(), msg.end());
+            framer.release();
+            co_await stream.async_wait(std::decay_t<StreamType>::wait_read, net::experimental::use_coro);
         }
+        auto buf = framer.prepare(policy.size());
+        auto read = co_await stream.async_read_some(net::buffer(buf.data(), buf.size()), net::experimental::use_coro);
+        framer.commit(read);
+        policy.update(buf.size(), read);
     }
 }
 
 
-
 }
 
 #endif //ASH_READER_HPP
@@ -0,0 +1,389 @@
+#ifndef ASH_SERVER_HPP
+#define ASH_SERVER_HPP
+
+#include <ash/config.hpp>
+#include <ash/shell.hpp>
+
+#if defined(BOOST_CAMPBELL)
+#include <boost/asio/experimental/channel.hpp>
+#else
+#include <asio/experimental/channel.hpp>
+#endif
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/socket.h>
+
+namespace ash
+{
+
+struct server_options
+{
+    // threads running the io_context, 0 means one per core.
+    std::size_t threads = 0u;
+    // sessions served at once; once that many are running, new connections wait in the backlog.
+    // A sharded_server caps every shard at max_sessions / shards, a shard that's full leaves the connections
+    // the kernel hashed to it in its backlog, even if the other shards still have room.
+    std::size_t max_sessions = 10000u;
+    int backlog = net::socket_base::max_listen_connections;
+    std::string prompt = "ash";
+    shell_options shell;
+    // pin the thread of each shard of a sharded_server to a core.
+    bool pin_threads = true;
+};
+
+namespace detail
+{
+
+// SO_REUSEPORT, which asio doesn't have an option for.
+struct reuse_port
+{
+    explicit reuse_port(bool value) : value_(value ? 1 : 0) {}
+
+    template<typename Protocol> int level(const Protocol &) const {return SOL_SOCKET;}
+    template<typename Protocol> int name(const Protocol &) const {return SO_REUSEPORT;}
+    template<typename Protocol> const int * data(const Protocol &) const {return &value_;}
+    template<typename Protocol> std::size_t size(const Protocol &) const {return sizeof(value_);}
+
+  private:
+    int value_;
+};
+
+// Accepts connections on one acceptor & runs a shell for each of them on the given io_context.
+// Sessions run on a strand of their own if the context is run by more than one thread.
+template<typename Protocol>
+struct listener
+{
+    using executor_type = net::any_io_executor;
+    using socket_type = typename Protocol::socket;
+    using endpoint_type = typename Protocol::endpoint;
+    using acceptor_type = typename Protocol::acceptor;
+
+    listener(net::io_context & ctx, command_set cmds, const endpoint_type & endpoint, server_options options,
+             bool strands, bool share_port = false)
+        : options_(std::move(options)),
+          ctx_(ctx),
+          strands_(strands),
+          commands_(std::move(cmds)),
+          acceptor_(strands ? executor_type(net::make_strand(ctx)) : executor_type(ctx.get_executor())),
+          slots_(acceptor_.get_executor(), options_.max_sessions)
+    {
+        acceptor_.open(endpoint.protocol());
+        if constexpr (std::is_same_v<Protocol, net::ip::tcp>)
+        {
+            acceptor_.set_option(typename acceptor_type::reuse_address(true));
+            // every shard gets its own listener on the same port, the kernel spreads the connections.
+            if (share_port)
+                acceptor_.set_option(reuse_port(true));
+        }
+        acceptor_.bind(endpoint);
+        acceptor_.listen(options_.backlog);
+        for (std::size_t i = 0u; i < options_.max_sessions; i++)
+            slots_.try_send(std::error_code{});
+    }
+
+    listener(const listener &) = delete;
+    listener& operator=(const listener &) = delete;
+
+    ~listener()
+    {
+        // the accept loop is still waiting on these, so they go before it does.
+        std::error_code ec;
+        acceptor_.close(ec);
+        slots_.close();
+        retry_.cancel();
+        // shells need to go before the context.
+        sessions_.clear();
+    }
+
+    executor_type get_executor() const {return acceptor_.get_executor();}
+    endpoint_type local_endpoint() const {return acceptor_.local_endpoint();}
+    std::size_t sessions() const {return session_count_.load(std::memory_order_relaxed);}
+
+    // the context still needs to be run.
+    void start() {accept_task_.async_resume(net::detached);}
+
+  private:
+    struct session
+    {
+        session(socket_type sock, const command_set & cmds, const server_options & options)
+            : socket(std::move(sock)), shell(socket, cmds, options.prompt, options.shell) {}
+
+        socket_type socket;
+        basic_shell<executor_type> shell;
+    };
+
+    using accept_task = net::experimental::coro<void, void, executor_type>;
+
+    accept_task accept_()
+    {
+        std::chrono::milliseconds backoff{0};
+        while (acceptor_.is_open())
+        {
+            // wait until there's room for another session.
+            co_await slots_.async_receive(net::experimental::use_coro);
+
+            socket_type sock{strands_ ? executor_type(net::make_strand(ctx_)) : executor_type(ctx_.get_executor())};
+            std::optional<std::error_code> ec;
+            try
+            {
+                co_await acceptor_.async_accept(sock, net::experimental::use_coro);
+            }
+            catch (const std::system_error & e)
+            {
+                ec = e.code();
+            }
+
+            if (ec)
+            {
+                // e.g. out of file descriptors; the connection stays in the backlog and gets retried,
+                // after a while, so the loop doesn't spin on the error.
+                if (*ec != net::error::operation_aborted)
+                {
+                    backoff = (std::clamp)(backoff * 2, std::chrono::milliseconds{10}, std::chrono::milliseconds{1000});
+                    retry_.expires_after(backoff);
+                    co_await retry_.async_wait(net::experimental::use_coro);
+                }
+                slots_.try_send(std::error_code{});
+                continue;
+            }
+            backoff = std::chrono::milliseconds{0};
+            if constexpr (std::is_same_v<Protocol, net::ip::tcp>)
+                sock.set_option(net::ip::tcp::no_delay(true));
+            start_(std::move(sock));
+        }
+    }
+
+    void start_(socket_type sock)
+    {
+        auto s = std::make_unique<session>(std::move(sock), commands_, options_);
+        const auto key = s.get();
+        {
+            std::lock_guard<std::mutex> lock{mutex_};
+            sessions_.emplace(key, std::move(s));
+        }
+        session_count_.fetch_add(1u, std::memory_order_relaxed);
+
+        key->shell.async_run(
+            [this, key](std::exception_ptr)
+            {
+                std::unique_ptr<session> done;
+                {
+                    std::lock_guard<std::mutex> lock{mutex_};
+                    auto itr = sessions_.find(key);
+                    if (itr == sessions_.end())
+                        return;
+                    done = std::move(itr->second);
+                    sessions_.erase(itr);
+                }
+                session_count_.fetch_sub(1u, std::memory_order_relaxed);
+                // we're still inside the shell's coroutine, so it goes once this handler returned.
+                auto exec = done->socket.get_executor();
+                net::post(exec, [done = std::move(done)] {});
+                net::post(get_executor(), [this] {slots_.try_send(std::error_code{});});
+            });
+    }
+
+    server_options options_;
+    net::io_context & ctx_;
+    bool strands_;
+    command_set commands_;
+    acceptor_type acceptor_;
+    // one message per free session slot.
+    net::experimental::channel<void(std::error_code)> slots_;
+    // backs off accepting after an error.
+    net::steady_timer retry_{acceptor_.get_executor()};
+
+    std::atomic<std::size_t> session_count_{0u};
+    std::mutex mutex_;
+    std::unordered_map<session*, std::unique_ptr<session>> sessions_;
+
+    accept_task accept_task_{accept_()};
+};
+
+}
+
+// an endpoint in the abstract namespace of unix domain sockets, that isn't a file & goes away with the last socket.
+inline net::local::stream_protocol::endpoint abstract_endpoint(std::string_view name)
+{
+    std::string path(1u, '\0');
+    path += name;
+    return net::local::stream_protocol::endpoint(path);
+}
+
+namespace detail
+{
+
+inline std::size_t server_threads(const server_options & options)
+{
+    return options.threads != 0u ? options.threads : (std::max)(std::thread::hardware_concurrency(), 1u);
+}
+
+// pin the calling thread to the n-th of the cpus it's allowed to run on, e.g. by taskset or a cgroup.
+inline void pin_to_core(std::size_t n)
+{
+#if defined(__linux__)
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    if (::sched_getaffinity(0, sizeof(allowed), &allowed) != 0 || CPU_COUNT(&allowed) == 0)
+        return;
+
+    n %= static_cast<std::size_t>(CPU_COUNT(&allowed));
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++)
+    {
+        if (!CPU_ISSET(cpu, &allowed) || n-- != 0u)
+            continue;
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(cpu, &set);
+        ::pthread_setaffinity_np(::pthread_self(), sizeof(set), &set);
+        return;
+    }
+#endif
+}
+
+}
+
+// Accepts connections & runs a shell for each of them, over tcp or unix domain sockets.
+// The sessions run on a multi-threaded io_context, each on its own strand, so a session never runs on two threads at once;
+// with a single thread, they skip the strands.
+//
+//     ash::server srv{cmds, {net::ip::address_v4::loopback(), 2323}, {.threads = 4}};
+//     ash::local_server admin{cmds, ash::abstract_endpoint("my-daemon-admin")};
+//
+// A unix domain socket bound to a path needs the file to be removed before it can be bound again.
+template<typename Protocol>
+struct basic_server
+{
+    using protocol_type = Protocol;
+    using executor_type = net::any_io_executor;
+    using endpoint_type = typename Protocol::endpoint;
+
+    basic_server(command_set cmds, const endpoint_type & endpoint, server_options options = {})
+        : threads_(detail::server_threads(options)),
+          ctx_(static_cast<int>(threads_)),
+          listener_(ctx_, std::move(cmds), endpoint, std::move(options), threads_ > 1u) {}
+
+    executor_type get_executor() const {return listener_.get_executor();}
+    // e.g. to get the port when binding to port 0.
+    endpoint_type local_endpoint() const {return listener_.local_endpoint();}
+    std::size_t threads() const {return threads_;}
+    // sessions currently running.
+    std::size_t sessions() const {return listener_.sessions();}
+
+    // serve on the configured number of threads, including the calling one, until stopped.
+    void run()
+    {
+        listener_.start();
+        std::vector<std::jthread> threads;
+        for (std::size_t i = 1u; i < threads_; i++)
+            threads.emplace_back([this] {ctx_.run();});
+        ctx_.run();
+    }
+
+    // makes run return; sessions still running get dropped when the server is destroyed.
+    void stop() {ctx_.stop();}
+
+  private:
+    std::size_t threads_;
+    net::io_context ctx_;
+    detail::listener<Protocol> listener_;
+};
+
+using server       = basic_server<net::ip::tcp>;
+using local_server = basic_server<net::local::stream_protocol>;
+
+// A shard per thread, each with its own single-threaded io_context, listener, buffer pool & copy of the commands.
+// The listeners share the port through SO_REUSEPORT, so the kernel spreads the connections over the shards
+// and nothing a session touches is shared with another core.
+// max_sessions gets split between the shards as a hard cap per shard, since the kernel doesn't know how full a shard is.
+// This needs SO_REUSEPORT, so it's tcp only.
+struct sharded_server
+{
+    using endpoint_type = net::ip::tcp::endpoint;
+
+    sharded_server(const command_set & cmds, const endpoint_type & endpoint, server_options options = {})
+        : pin_threads_(options.pin_threads)
+    {
+        const auto n = detail::server_threads(options);
+        options.max_sessions = (std::max)(options.max_sessions / n, std::size_t{1u});
+        shards_.reserve(n);
+        auto ep = endpoint;
+        for (std::size_t i = 0u; i < n; i++)
+        {
+            shards_.push_back(std::make_unique<shard>(cmds.clone(), ep, options));
+            // if it was bound to port 0, the other shards need to use the one it got.
+            ep = shards_.back()->listener.local_endpoint();
+        }
+    }
+
+    endpoint_type local_endpoint() const {return shards_.front()->listener.local_endpoint();}
+    std::size_t shards() const {return shards_.size();}
+    std::size_t sessions() const
+    {
+        std::size_t res = 0u;
+        for (const auto & s : shards_)
+            res += s->listener.sessions();
+        return res;
+    }
+
+    // run every shard on a thread of its own & wait until they're stopped.
+    void run()
+    {
+        std::vector<std::jthread> threads;
+        for (std::size_t i = 0u; i < shards_.size(); i++)
+            threads.emplace_back(
+                [this, i]
+                {
+                    if (pin_threads_)
+                        detail::pin_to_core(i);
+                    shards_[i]->listener.start();
+                    shards_[i]->ctx.run();
+                });
+    }
+
+    void stop()
+    {
+        for (auto & s : shards_)
+            s->ctx.stop();
+    }
+
+  private:
+    struct shard
+    {
+        shard(command_set cmds, const endpoint_type & endpoint, server_options options)
+            : listener(ctx, std::move(cmds), endpoint, with_pool_(std::move(options)), false, true) {}
+
+        // the sessions' buffers go back to the pool when the context drops them, so it needs to outlive it.
+        buffer_pool pool;
+        net::io_context ctx{1};
+        detail::listener<net::ip::tcp> listener;
+
+      private:
+        server_options with_pool_(server_options options)
+        {
+            options.shell.pool = &pool;
+            return options;
+        }
+    };
+
+    bool pin_threads_;
+    std::vector<std::unique_ptr<shard>> shards_;
+};
+
+}
+
+#endif //ASH_SERVER_HPP
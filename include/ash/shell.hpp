@@ -1,39 +1,55 @@
 #ifndef ASH_SHELL_HPP
 #define ASH_SHELL_HPP
 
+#include <ash/command.hpp>
 #include <ash/config.hpp>
 #include <ash/reader.hpp>
 
-#include <map>
+#include <array>
+#include <cstddef>
 #include <functional>
+#include <iterator>
+#include <map>
+#include <memory>
+#include <memory_resource>
+#include <optional>
+#include <span>
+#include <type_traits>
+#include <version>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#if defined(__cpp_lib_format)
+#include <format>
+#endif
 
 namespace ash
 {
 
-template<typename Executor = net::any_io_executor>
-using basic_cmd_task = net::experimental::coro<void, void, Executor>;
-
-template<typename Executor>
-struct basic_context;
-
-template<typename Executor>
-struct basic_shell;
-
-template<typename Executor = net::any_io_executor>
-struct basic_cmd
+enum class shell_mode
 {
-    using executor_type = Executor;
-    using context_type = basic_context<executor_type>;
-    using cmd_task = basic_cmd_task<executor_type>;
-
-    std::string name;
-    std::vector<std::string> aliases;
+    automatic,   // batch, if the input of an fd based shell isn't a terminal
+    interactive,
+    batch        // no prompts, output only gets flushed when the queue is full or the input runs dry, large reads
+};
 
-    std::function<cmd_task(context_type)> run;
-    std::string help;
-    std::string description;
+struct shell_options
+{
+    shell_mode mode = shell_mode::automatic;
+    // how much gets read from a stream at once.
+    read_size_policy read_size;
+    buffer_pool * pool = &buffer_pool::default_pool();
+    // output gets queued & written once a command is done, or earlier if this much is queued.
+    std::size_t flush_threshold = 16u * 1024u;
+};
 
-    std::vector<basic_cmd<executor_type>> children;
+struct peer_credentials
+{
+    ::pid_t pid;
+    ::uid_t uid;
+    ::gid_t gid;
 };
 
 template<typename Executor = net::any_io_executor>
@@ -42,31 +58,57 @@ struct basic_shell
     using executor_type = Executor;
     using cmd_task = basic_cmd_task<executor_type>;
     using cmd = basic_cmd<executor_type>;
+    using command_set = basic_command_set<executor_type>;
     using chunk_reader = basic_chunk_reader<executor_type>;
     using chunk_writer = basic_chunk_writer<executor_type>;
 
-    using shell_task = net::experimental::coro<void, void, executor_type >;
+    using shell_task = net::experimental::coro<void, void, executor_type, frame_allocator<>>;
+    // what the read functions return; like commands, their frames come from the frame_pool.
+    template<typename Return>
+    using read_task = net::experimental::coro<void, Return, executor_type, frame_allocator<>>;
     using token_reader = basic_token_reader<executor_type>;
 
     executor_type get_executor() const {return reader_.get_executor();}
 
-    basic_shell(chunk_reader reader, chunk_writer writer, const std::string  & prompt = "ash")
-            : reader_(read(std::move(reader))), writer_(std::move(writer)), prompt_(prompt) {}
+    basic_shell(chunk_reader reader, chunk_writer writer, const std::string  & prompt = "ash",
+                const shell_options & options = {})
+            : batch_(options.mode == shell_mode::batch), read_size_(read_size_for_(options)),
+              reader_(read(std::move(reader), {}, read_options_(options))), writer_(std::move(writer)), prompt_(prompt),
+              flush_threshold_(options.flush_threshold) {}
+
+    basic_shell(chunk_reader reader, chunk_writer writer, command_set cmds, const std::string  & prompt = "ash",
+                const shell_options & options = {})
+            : commands_(std::move(cmds)), prompt_(prompt + "> "),
+              batch_(options.mode == shell_mode::batch), read_size_(read_size_for_(options)),
+              reader_(read(std::move(reader), {}, read_options_(options))), writer_(std::move(writer)),
+              flush_threshold_(options.flush_threshold) {}
 
     basic_shell(
-            executor_type exec, const std::vector<cmd> & cmds,
-            int fd_source = STDIN_FILENO, int fd_sink = STDOUT_FILENO, const std::string  & prompt = "ash") :
-            cmds_(cmds),  prompt_(prompt + "> "),
-            reader_(read(stream_reader<net::posix::basic_stream_descriptor<Executor>>({exec, fd_source}))),
-            writer_(stream_writer<net::posix::basic_stream_descriptor<Executor>>({exec, fd_sink}, prompt_))
+            executor_type exec, command_set cmds,
+            int fd_source = STDIN_FILENO, int fd_sink = STDOUT_FILENO, const std::string  & prompt = "ash",
+            const shell_options & options = {}) :
+            commands_(std::move(cmds)),  prompt_(prompt + "> "),
+            batch_(options.mode == shell_mode::batch || (options.mode == shell_mode::automatic && !::isatty(fd_source))),
+            read_size_(read_size_for_(options)),
+            reader_(ash::read<net::posix::basic_stream_descriptor<Executor>>({exec, fd_source}, {},
+                                                                             read_options_(options, regular_file_(fd_source)))),
+            writer_(stream_writer<net::posix::basic_stream_descriptor<Executor>>({exec, fd_sink})),
+            flush_threshold_(options.flush_threshold)
     {}
 
+    // a tcp or unix domain socket; the socket needs to outlive the shell.
+    template<typename Protocol>
     basic_shell(
-            net::ip::tcp::socket & sock, const std::vector<cmd> & cmds, const std::string  & prompt = "ash") :
-            cmds_(cmds),
+            net::basic_stream_socket<Protocol, Executor> & sock, command_set cmds, const std::string  & prompt = "ash",
+            const shell_options & options = {}) :
+            commands_(std::move(cmds)),
             prompt_(prompt + "> "),
-            reader_(read(stream_reader<net::ip::tcp::socket &>(sock))),
-            writer_(stream_writer<net::ip::tcp::socket &>(sock, prompt_))
+            batch_(options.mode == shell_mode::batch),
+            read_size_(read_size_for_(options)),
+            reader_(ash::read<net::basic_stream_socket<Protocol, Executor> &>(sock, {}, read_options_(options))),
+            writer_(stream_writer<net::basic_stream_socket<Protocol, Executor> &>(sock)),
+            flush_threshold_(options.flush_threshold),
+            peer_credentials_(peer_credentials_of_(sock))
     {}
 
     template<typename Handler>
@@ -75,11 +117,40 @@ struct basic_shell
         return task_.async_resume(std::forward<Handler>(handler));
     }
 
-    auto clear_screen() {return writer_("\e[1;1H\e[2J");}
-    auto write(std::string_view data) {return writer_(data);}
+    // output gets queued, so awaiting it only suspends when the queue gets flushed.
+    auto clear_screen() {return queue_("\e[1;1H\e[2J");}
+    // the queue itself, for synchronous commands; it gets written once the command is done.
+    std::string & output() {return output_;}
+    auto write(std::string_view data) {return queue_(data);}
 
-    auto read_line() -> net::experimental::coro<void, std::string_view, Executor>
+    // gather the buffers into the queue; the awaitable yields 0, as it only flushes.
+    template<typename ConstBufferSequence>
+        requires net::is_const_buffer_sequence<ConstBufferSequence>::value
+    auto write(const ConstBufferSequence & buffers)
     {
+        for (auto itr = net::buffer_sequence_begin(buffers); itr != net::buffer_sequence_end(buffers); itr++)
+        {
+            const net::const_buffer buf{*itr};
+            output_.append(static_cast<const char*>(buf.data()), buf.size());
+        }
+        return queue_(std::string_view{});
+    }
+
+#if defined(__cpp_lib_format)
+    // format straight into the queue.
+    template<typename ... Args>
+    auto print(std::format_string<Args...> fmt, Args && ... args)
+    {
+        std::format_to(std::back_inserter(output_), fmt, std::forward<Args>(args)...);
+        return queue_(std::string_view{});
+    }
+#endif
+
+    auto read_line() -> read_task<std::string_view>
+    {
+        // whatever the command asked for should be visible before waiting for the answer.
+        if (flush_before_read_())
+            co_await flush_();
         auto v = co_await reader_(reader_mode{reader_mode::raw_line_t{}});
         if (!v)
             co_return "";
@@ -87,20 +158,26 @@ struct basic_shell
             co_return v->raw_input;
     }
 
-    auto read_tokenized()
+    auto read_tokenized() -> read_task<std::optional<tokenized_view>>
     {
-        return reader_(reader_mode{reader_mode::tokenize_t{}});
+        if (flush_before_read_())
+            co_await flush_();
+        co_return co_await reader_(reader_mode{reader_mode::tokenize_t{&arena_}});
     }
-    auto read_multiline(std::string_view eoi) -> net::experimental::coro<void, std::string_view, Executor>
+    auto read_multiline(std::string_view eoi) -> read_task<std::string_view>
     {
+        if (flush_before_read_())
+            co_await flush_();
         auto v = co_await reader_(reader_mode::multiline_with_terminator_t{eoi});
         if (!v)
             co_return "";
         else
             co_return v->raw_input;
     }
-    auto read_multiline(std::function<bool(std::string_view)> predicate) -> net::experimental::coro<void, std::string_view, Executor>
+    auto read_multiline(std::function<bool(std::string_view)> predicate) -> read_task<std::string_view>
     {
+        if (flush_before_read_())
+            co_await flush_();
         auto v = co_await reader_(reader_mode::multiline_with_predicate_t{predicate});
         if (!v)
             co_return "";
@@ -114,19 +191,91 @@ struct basic_shell
         prompt_ += "> ";
     }
     std::string_view get_prompt() const {return std::string_view(prompt_).substr(0, prompt_.size() - 2);}
+
+    // memory for the current command, that gets released once it's done.
+    std::pmr::memory_resource & arena() {return arena_;}
+
+    // what the reader did so far.
+    const read_stats & stats() const {return read_size_.stats;}
+
+    // who's on the other end of a unix domain socket, as the kernel saw it when connecting.
+    const std::optional<peer_credentials> & get_peer_credentials() const {return peer_credentials_;}
   private:
+    template<typename Protocol>
+    static std::optional<peer_credentials> peer_credentials_of_(net::basic_stream_socket<Protocol, Executor> & sock)
+    {
+#if defined(SO_PEERCRED)
+        if constexpr (std::is_same_v<Protocol, net::local::stream_protocol>)
+        {
+            ::ucred cred{};
+            ::socklen_t len = sizeof(cred);
+            if (::getsockopt(sock.native_handle(), SOL_SOCKET, SO_PEERCRED, &cred, &len) == 0)
+                return peer_credentials{cred.pid, cred.uid, cred.gid};
+        }
+#endif
+        return std::nullopt;
+    }
+
+    read_options read_options_(const shell_options & options, bool regular_file = false)
+    {
+        return {.pool = options.pool, .read_size = &read_size_, .wait_for_readiness = !regular_file,
+                .line_buffered = batch_ ? &line_buffered_ : nullptr};
+    }
+
+    // regular files can't be waited on, they're always readable.
+    static bool regular_file_(int fd)
+    {
+        struct ::stat st;
+        return ::fstat(fd, &st) == 0 && S_ISREG(st.st_mode);
+    }
+
+    // a batch shell reads as much as it can right away.
+    read_size_policy read_size_for_(const shell_options & options) const
+    {
+        if (batch_)
+            return {options.read_size.max_size, options.read_size.max_size};
+        else
+            return options.read_size;
+    }
+
+    // a batch shell only writes when the queue is full, or the read would need to wait for input;
+    // a peer might wait for the replies before sending more.
+    bool flush_before_read_() const {return !output_.empty() && (!batch_ || !line_buffered_);}
+
+    // hand the queued output to the writer; swapped out, so the queue can keep growing during the write.
+    auto flush_()
+    {
+        std::swap(output_, in_flight_);
+        output_.clear();
+        return writer_(std::string_view{in_flight_});
+    }
+
     executor_type executor_;
 
-    std::vector<cmd> cmds_;
+    command_set commands_;
     std::string prompt_;
 
+    bool batch_;
+    // the reader has the next line already, only kept track of in batch mode.
+    bool line_buffered_ = false;
+    read_size_policy read_size_;
     token_reader reader_;
     chunk_writer writer_;
 
+    std::size_t flush_threshold_;
+    std::string output_;
+    std::string in_flight_;
+    chunk_writer queue_impl_(std::string_view msg = "");
+    chunk_writer queue_{queue_impl_()};
+
+    std::optional<peer_credentials> peer_credentials_;
+
+    std::array<std::byte, 4096u> arena_buffer_;
+    std::pmr::monotonic_buffer_resource arena_{arena_buffer_.data(), arena_buffer_.size()};
+
     shell_task task_impl_();
     shell_task task_{task_impl_()};
 
-    std::string build_help_(const std::vector<std::string_view> & tk);
 };
 
 template<typename Executor = net::any_io_executor>
@@ -136,107 +285,64 @@ struct basic_context
 
     executor_type get_executor() const {return shell.get_executor();}
 
-    std::vector<std::string_view> &args;
+    std::span<const std::string_view> args;
     std::string_view &raw_line;
-    std::vector<std::string_view> &full_args;
+    const token_list &full_args;
 
     basic_shell<Executor> &shell;
 
     auto clear_screen() {return shell.clear_screen(); }
+    auto & arena() {return shell.arena();}
+    std::string & output() {return shell.output();}
+    // only set for unix domain sockets.
+    const std::optional<ash::peer_credentials> & peer_credentials() const {return shell.get_peer_credentials();}
     auto write(std::string_view data) {return shell.write(data);}
+    template<typename ConstBufferSequence>
+        requires net::is_const_buffer_sequence<ConstBufferSequence>::value
+    auto write(const ConstBufferSequence & buffers) {return shell.write(buffers);}
+#if defined(__cpp_lib_format)
+    template<typename ... Args>
+    auto print(std::format_string<Args...> fmt, Args && ... args) {return shell.print(fmt, std::forward<Args>(args)...);}
+#endif
     auto read_line() {return shell.read_line(); }
     auto read_tokenized() {return shell.read_tokenized(); }
     auto read_multiline(std::string_view eoi) {return shell.read_multiline(eoi); }
     auto read_multiline(std::function<bool(std::string_view)> predicate) {return shell.read_multiline(predicate); }
 };
 
-template<typename Executor, typename Iterator>
-inline std::pair<const basic_cmd<Executor>*, std::size_t>
-    find_command(Iterator begin, Iterator end,
-                 const std::vector<basic_cmd<Executor>> & cmds,
-                 std::size_t depth = 0u)
-{
-
-    auto nx = *begin;
-    auto cmd_itr = std::find_if(cmds.begin(), cmds.end(),
-                                [&](auto & c)
-                                {
-                                    return c.name == nx
-                                         || std::find(c.aliases.begin(), c.aliases.end(), nx) != c.aliases.end();
-                                });
-
-    if (cmd_itr != cmds.end())
-    {
-        //found a command, see if I can find a a nested one
-        auto nested = find_command(std::next(begin), end, cmd_itr->children, depth + 1);
-        if (nested.first)
-            return nested;
-        else
-            return {&*cmd_itr, depth + 1};
-    }
-    else
-        return {nullptr, depth};
-}
-
-
 template<typename Executor>
-std::string basic_shell<Executor>::build_help_(const std::vector<std::string_view> & tk)
+auto basic_shell<Executor>::queue_impl_(std::string_view msg) -> chunk_writer
 {
-    if (tk.size() > 1)
+    while (true)
     {
-        auto [cmd, depth] = find_command(std::next(tk.begin()) , tk.end(), cmds_);
-        if (!cmd)
-            return "cannot find command help was requested for.\n";
-
-        std::string res = cmd->help + "\n   " + cmd->description + "\n";
-        if (!cmd->children.empty())
-        {
-            res +=  "  subcommands:";
-            for (const auto & c : cmd->children)
-            {
-                res += "\n    - " + c.name + "\n        " + c.help;
-                if (!c.aliases.empty())
-                {
-                    res += "\n      aliases:";
-                    for (const auto &a : c.aliases)
-                        res += "\n        - " + a;
-                }
-            }
-        }
-        return res + "\n";
-    }
-    else
-    {
-        std::string res = R"(
-root commands:
-    - help [cmds...]
-        print this help.
-    - exit
-        end this program)";
-
-        for (const auto & c : cmds_)
-        {
-            res += "\n    - " + c.name + "\n        " + c.help;
-            if (!c.aliases.empty())
-            {
-                res += "\n      aliases:";
-                for (const auto &a : c.aliases)
-                    res += "\n        - " + a;
-            }
-        }
-
-        return res + "\n";
+        output_ += msg;
+        if (output_.size() >= flush_threshold_)
+            co_await flush_();
+        msg = co_yield msg.size();
     }
 }
 
-
 template<typename Executor>
 auto basic_shell<Executor>::task_impl_() -> shell_task
 {
+    // the first resume of a coro runs it up to its first yield, the value passed in gets lost.
+    co_await writer_(std::string_view{});
+    co_await queue_(std::string_view{});
     while (true)
     {
-        co_await writer_(prompt_);
-        auto cmd_ = co_await reader_(reader_mode());
+        arena_.release();
+        // the prompt goes out together with the output of the last command.
+        if (!batch_)
+        {
+            output_ += prompt_;
+            co_await flush_();
+        }
+        else if (flush_before_read_())
+            co_await flush_();
+        // pinned, so the command's tokens survive the reads done by the command itself.
+        reader_mode mode{reader_mode::tokenize_t{&arena_}};
+        mode.pin = true;
+        auto cmd_ = co_await reader_(std::move(mode));
 
         if (!cmd_)
             break;
@@ -245,33 +351,45 @@ auto basic_shell<Executor>::task_impl_() -> shell_task
         if (cc.tokens.empty())
             continue;
 
+        // the command tree might have changed while we were waiting for input.
+        commands_.refresh();
+
         auto nm = cc.tokens.front();
         if (nm == "exit")
             break;
         else if (nm == "help")
         {
-            auto msg = build_help_(cc.tokens);
-            co_await writer_(msg);
+            commands_.help(std::next(cc.tokens.begin()), cc.tokens.end(), output_);
+            co_await queue_(std::string_view{});
         }
-        else if (auto [cd, depth] = find_command(cc.tokens.begin(), cc.tokens.end(), cmds_); cd != nullptr)
+        else if (auto cd = commands_.find(cc.tokens.begin(), cc.tokens.end()))
         {
-            std::vector<std::string_view> args;
-            args.resize(cc.tokens.size() - depth);
-            std::copy(cc.tokens.begin() + depth, cc.tokens.end(), args.begin());
+            const auto depth = cd.depth;
+            std::pmr::polymorphic_allocator<std::string_view> alloc{&arena_};
+            const std::span<std::string_view> args{alloc.allocate(cc.tokens.size() - depth), cc.tokens.size() - depth};
+            std::uninitialized_copy(cc.tokens.begin() + depth, cc.tokens.end(), args.begin());
 
-            co_await cd->run({ args, cc.raw_input, cc.tokens, *this});
+            if (cd.is_sync())
+            {
+                // no frame & no resumes; the output goes out with the next flush, like a write that didn't suspend.
+                basic_context<Executor> ctx{args, cc.raw_input, cc.tokens, *this};
+                cd.run_inline(ctx);
+                co_await queue_(std::string_view{});
+            }
+            else
+                co_await cd({ args, cc.raw_input, cc.tokens, *this});
         }
         else
-            co_await writer_("command not found\n");
+            co_await queue_("command not found\n");
     }
 
+    if (!output_.empty())
+        co_await flush_();
     co_return;
 }
 
 
-using cmd_task = basic_cmd_task<>;
 using shell    = basic_shell<>;
-using cmd      = basic_cmd<>;
 using context  = basic_context<>;
 
 }
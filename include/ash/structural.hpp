@@ -0,0 +1,158 @@
+#ifndef ASH_STRUCTURAL_HPP
+#define ASH_STRUCTURAL_HPP
+
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+
+#if defined(__AVX2__) || defined(__SSE2__) || defined(_M_X64)
+#include <immintrin.h>
+#endif
+
+namespace ash
+{
+
+// One bit per byte of a block of up to 64 bytes, marking the characters the line_tokenizer cares about.
+struct structural_masks
+{
+    constexpr static std::size_t block_size = 64u;
+
+    std::uint64_t line_break   = 0u;
+    std::uint64_t semi_colon   = 0u;
+    std::uint64_t double_quote = 0u;
+    std::uint64_t single_quote = 0u;
+    std::uint64_t backslash    = 0u;
+    std::uint64_t hash         = 0u;
+    std::uint64_t space        = 0u; // whitespace except line breaks
+    std::uint64_t valid        = 0u; // bytes that are part of the block
+};
+
+namespace detail
+{
+
+inline structural_masks classify_scalar(const char * data, std::size_t size)
+{
+    structural_masks res;
+    res.valid = size >= structural_masks::block_size ? ~std::uint64_t{0u} : ((std::uint64_t{1u} << size) - 1u);
+    for (std::size_t i = 0u; i < size && i < structural_masks::block_size; i++)
+    {
+        const auto bit = std::uint64_t{1u} << i;
+        switch (data[i])
+        {
+            case '\n': res.line_break   |= bit; break;
+            case ';':  res.semi_colon   |= bit; break;
+            case '"':  res.double_quote |= bit; break;
+            case '\'': res.single_quote |= bit; break;
+            case '\\': res.backslash    |= bit; break;
+            case '#':  res.hash         |= bit; break;
+            case ' ': case '\t': case '\v': case '\f': case '\r':
+                       res.space        |= bit; break;
+            default: break;
+        }
+    }
+    return res;
+}
+
+#if defined(__AVX2__)
+
+inline structural_masks classify_full_block(const char * data)
+{
+    auto mask = [](__m256i lo, __m256i hi)
+    {
+        return static_cast<std::uint32_t>(_mm256_movemask_epi8(lo))
+             | (static_cast<std::uint64_t>(static_cast<std::uint32_t>(_mm256_movemask_epi8(hi))) << 32u);
+    };
+    const auto lo = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data));
+    const auto hi = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + 32));
+    auto eq = [&](char c)
+    {
+        const auto v = _mm256_set1_epi8(c);
+        return mask(_mm256_cmpeq_epi8(lo, v), _mm256_cmpeq_epi8(hi, v));
+    };
+    // \t, \n, \v, \f & \r are 9 - 13, i.e. c - 9 <= 4 unsigned.
+    auto control_space = [](__m256i v)
+    {
+        const auto shifted = _mm256_sub_epi8(v, _mm256_set1_epi8(9));
+        return _mm256_cmpeq_epi8(_mm256_min_epu8(shifted, _mm256_set1_epi8(4)), shifted);
+    };
+
+    structural_masks res;
+    res.valid        = ~std::uint64_t{0u};
+    res.line_break   = eq('\n');
+    res.semi_colon   = eq(';');
+    res.double_quote = eq('"');
+    res.single_quote = eq('\'');
+    res.backslash    = eq('\\');
+    res.hash         = eq('#');
+    res.space        = (eq(' ') | mask(control_space(lo), control_space(hi))) & ~res.line_break;
+    return res;
+}
+
+#elif defined(__SSE2__) || defined(_M_X64)
+
+inline structural_masks classify_full_block(const char * data)
+{
+    __m128i v[4];
+    for (int i = 0; i < 4; i++)
+        v[i] = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 16 * i));
+
+    auto combine = [&](auto && op)
+    {
+        std::uint64_t res = 0u;
+        for (int i = 0; i < 4; i++)
+            res |= static_cast<std::uint64_t>(static_cast<std::uint16_t>(_mm_movemask_epi8(op(v[i])))) << (16 * i);
+        return res;
+    };
+    auto eq = [&](char c)
+    {
+        const auto s = _mm_set1_epi8(c);
+        return combine([&](__m128i x) {return _mm_cmpeq_epi8(x, s);});
+    };
+    // \t, \n, \v, \f & \r are 9 - 13, i.e. c - 9 <= 4 unsigned.
+    auto control_space = [](__m128i x)
+    {
+        const auto shifted = _mm_sub_epi8(x, _mm_set1_epi8(9));
+        return _mm_cmpeq_epi8(_mm_min_epu8(shifted, _mm_set1_epi8(4)), shifted);
+    };
+
+    structural_masks res;
+    res.valid        = ~std::uint64_t{0u};
+    res.line_break   = eq('\n');
+    res.semi_colon   = eq(';');
+    res.double_quote = eq('"');
+    res.single_quote = eq('\'');
+    res.backslash    = eq('\\');
+    res.hash         = eq('#');
+    res.space        = (eq(' ') | combine(control_space)) & ~res.line_break;
+    return res;
+}
+
+#endif
+
+}
+
+// classify the next (up to) 64 bytes.
+inline structural_masks classify(const char * data, std::size_t size)
+{
+#if defined(__AVX2__) || defined(__SSE2__) || defined(_M_X64)
+    if (size >= structural_masks::block_size)
+        return detail::classify_full_block(data);
+
+    // don't read past the end of the input.
+    char padded[structural_masks::block_size] = {};
+    std::memcpy(padded, data, size);
+    auto res = detail::classify_full_block(padded);
+    const auto valid = (std::uint64_t{1u} << size) - 1u;
+    for (auto m : {&res.line_break, &res.semi_colon, &res.double_quote, &res.single_quote,
+                   &res.backslash, &res.hash, &res.space})
+        *m &= valid;
+    res.valid = valid;
+    return res;
+#else
+    return detail::classify_scalar(data, size);
+#endif
+}
+
+}
+
+#endif //ASH_STRUCTURAL_HPP
@@ -20,31 +20,486 @@ PROVIDE MAINTENANCE, SUPPORT, UPDATES, ENHANCEMENTS, OR MODIFICATIONS.
 #define ASH_TOKENIZER_HPP
 
 #include <ctre.hpp>
+#include <ash/structural.hpp>
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <compare>
+#include <concepts>
+#include <cstdint>
+#include <iterator>
+#include <memory_resource>
+#include <ranges>
+#include <string_view>
+#include <type_traits>
+#include <utility>
 #include <vector>
-#include <vector>
+
 namespace ash
 {
 
 constexpr auto line_matcher = ctre::starts_with<R"rx(\s*((?:"(?:[^"\\]|\\.)*"|'(?:[^'\\]|\\.)*'|#[^\n]*\n|\\[^\n]*\n|[^;\n])*)(?:;|\n))rx">;
 
+constexpr auto tokenizer = ctre::tokenize<R"rx("((?:[^"\\]|\\.)*)"|'((?:[^'\\]|\\.)*)'|#([^\n]*)\n|(\\)|(;)|(\n)|([^\s"']+)|(\s+))rx">;
+
+enum class token_kind : std::uint8_t
+{
+    regular,
+    double_quoted,
+    single_quoted
+};
+
+// a token as offset & length relative to the scanned data, so it survives the data being moved.
+struct token_span
+{
+    std::size_t offset;
+    std::size_t length;
+    token_kind kind;
+};
+
+namespace detail
+{
+
+enum class tokenizer_state : std::uint8_t
+{
+    leading_whitespace,
+    between_tokens,
+    regular,
+    regular_backslash,
+    double_quoted,
+    double_quoted_escape,
+    single_quoted,
+    single_quoted_escape,
+    comment,          // a comment before the first token, the line continues after it
+    after_comment,
+    trailing_comment, // a comment after the tokens, the line ends with it
+    line_extension,
+    size_
+};
+
+enum tokenizer_char_class : std::uint8_t
+{
+    other,
+    space,
+    line_break,
+    semi_colon,
+    double_quote,
+    single_quote,
+    backslash,
+    hash,
+    tokenizer_char_class_size_
+};
+
+enum tokenizer_action : std::uint8_t
+{
+    none         = 0,
+    begin_line   = 1 << 0,
+    begin_token  = 1 << 1, // regular token starting at the current char
+    begin_quoted = 1 << 2, // quoted token starting after the current char
+    end_token    = 1 << 3, // token ends before the current char
+    end_token_before_backslash = 1 << 4,
+    end_line     = 1 << 5,
+    reprocess    = 1 << 6  // look at the current char again in the next state
+};
+
+struct tokenizer_transition
+{
+    tokenizer_state next;
+    std::uint8_t actions;
+};
+
+constexpr std::array<tokenizer_char_class, 256> tokenizer_char_classes = []
+{
+    std::array<tokenizer_char_class, 256> res{};
+    for (auto c : {' ', '\t', '\v', '\f', '\r'})
+        res[static_cast<unsigned char>(c)] = space;
+    res['\n']  = line_break;
+    res[';']   = semi_colon;
+    res['"']   = double_quote;
+    res['\'']  = single_quote;
+    res['\\']  = backslash;
+    res['#']   = hash;
+    return res;
+}();
+
+constexpr tokenizer_transition tokenizer_transition_for(tokenizer_state st, tokenizer_char_class cc)
+{
+    switch (st)
+    {
+        case tokenizer_state::leading_whitespace:
+            if (cc == space || cc == line_break)
+                return {st, none};
+            else if (cc == hash)
+                return {tokenizer_state::comment, begin_line};
+            else
+            {
+                auto t = tokenizer_transition_for(tokenizer_state::between_tokens, cc);
+                t.actions |= begin_line;
+                return t;
+            }
+        case tokenizer_state::after_comment:
+            if (cc == space || cc == line_break)
+                return {st, none};
+            else if (cc == hash)
+                return {tokenizer_state::comment, none};
+            else
+                return tokenizer_transition_for(tokenizer_state::between_tokens, cc);
+        case tokenizer_state::between_tokens:
+            switch (cc)
+            {
+                case space:        return {st, none};
+                case line_break:
+                case semi_colon:   return {tokenizer_state::leading_whitespace, end_line};
+                case double_quote: return {tokenizer_state::double_quoted, begin_quoted};
+                case single_quote: return {tokenizer_state::single_quoted, begin_quoted};
+                case backslash:    return {tokenizer_state::line_extension, none};
+                case hash:         return {tokenizer_state::trailing_comment, none};
+                default:           return {tokenizer_state::regular, begin_token};
+            }
+        case tokenizer_state::regular:
+            switch (cc)
+            {
+                case space:        return {tokenizer_state::between_tokens, end_token};
+                case line_break:
+                case semi_colon:   return {tokenizer_state::leading_whitespace, end_token | end_line};
+                case double_quote: return {tokenizer_state::double_quoted, end_token | begin_quoted};
+                case single_quote: return {tokenizer_state::single_quoted, end_token | begin_quoted};
+                case backslash:    return {tokenizer_state::regular_backslash, none};
+                default:           return {st, none};
+            }
+        case tokenizer_state::regular_backslash:
+            if (cc == line_break)
+                return {tokenizer_state::between_tokens, end_token_before_backslash};
+            else
+                return {tokenizer_state::regular, reprocess};
+        case tokenizer_state::double_quoted:
+            if (cc == backslash)
+                return {tokenizer_state::double_quoted_escape, none};
+            else if (cc == double_quote)
+                return {tokenizer_state::between_tokens, end_token};
+            else
+                return {st, none};
+        case tokenizer_state::double_quoted_escape:
+            return {tokenizer_state::double_quoted, none};
+        case tokenizer_state::single_quoted:
+            if (cc == backslash)
+                return {tokenizer_state::single_quoted_escape, none};
+            else if (cc == single_quote)
+                return {tokenizer_state::between_tokens, end_token};
+            else
+                return {st, none};
+        case tokenizer_state::single_quoted_escape:
+            return {tokenizer_state::single_quoted, none};
+        case tokenizer_state::comment:
+            return {cc == line_break ? tokenizer_state::after_comment : st, none};
+        case tokenizer_state::trailing_comment:
+            if (cc == line_break)
+                return {tokenizer_state::leading_whitespace, end_line};
+            else
+                return {st, none};
+        case tokenizer_state::line_extension:
+            if (cc == line_break)
+                return {tokenizer_state::between_tokens, none};
+            else if (cc == space)
+                return {st, none};
+            else
+                return {tokenizer_state::between_tokens, reprocess};
+        default:
+            return {st, none};
+    }
+}
+
+constexpr auto tokenizer_transitions = []
+{
+    std::array<std::array<tokenizer_transition, tokenizer_char_class_size_>, static_cast<std::size_t>(tokenizer_state::size_)> res{};
+    for (std::size_t st = 0u; st < res.size(); st++)
+        for (std::size_t cc = 0u; cc < tokenizer_char_class_size_; cc++)
+            res[st][cc] = tokenizer_transition_for(static_cast<tokenizer_state>(st), static_cast<tokenizer_char_class>(cc));
+    return res;
+}();
+
+}
+
+// Single pass, table driven state machine finding the end of a line (`;` or `\n`) and the tokens in it.
+// It keeps its state between calls, so data can be scanned as it comes in.
+//
+// The grammar is the one of line_matcher & tokenizer, but for comments after the tokens:
+//   - leading whitespace, including line breaks, is skipped
+//   - "double" and 'single' quoted tokens with backslash escapes, which may span multiple lines
+//   - a `#` at the start of a token comments out the rest of the line. A comment before the first token
+//     includes its line break, so comment-only lines are skipped. A comment after the tokens ends the line
+//     at its line break, where line_matcher would carry on with the next line.
+//   - a `\` followed by a line break extends the line
+struct line_tokenizer
+{
+    using state = detail::tokenizer_state;
+
+    // offset of the first character of the line, i.e. after the leading whitespace.
+    std::size_t begin = 0u;
+    // offset up to which the input has been scanned.
+    std::size_t position = 0u;
+    state current = state::leading_whitespace;
+    // the token currently being scanned
+    std::size_t token_begin = 0u;
+    token_kind token = token_kind::regular;
+
+    // continue scanning data, of which the first `position` bytes have already been seen,
+    // passing every complete token_span to `sink`.
+    // returns the offset of the terminating `;` or `\n` or npos if the line is incomplete.
+    template<typename Sink>
+    constexpr std::size_t scan(std::string_view data, Sink && sink)
+    {
+        structural_masks masks;
+        auto masks_offset = std::string_view::npos;
+        while (position < data.size())
+        {
+            // use the bitmasks to jump to the next character, that does anything in the current state.
+            if (!std::is_constant_evaluated())
+            {
+                const auto block = position - position % structural_masks::block_size;
+                if (block != masks_offset)
+                {
+                    masks = classify(data.data() + block, (std::min)(structural_masks::block_size, data.size() - block));
+                    masks_offset = block;
+                }
+                const auto stops = stops_(current, masks) & (~std::uint64_t{0u} << (position - block));
+                if (stops == 0u)
+                {
+                    position = (std::min)(block + structural_masks::block_size, data.size());
+                    continue;
+                }
+                position = block + static_cast<std::size_t>(std::countr_zero(stops));
+            }
+
+            using namespace detail;
+            const auto [next, actions] =
+                    tokenizer_transitions[static_cast<std::size_t>(current)]
+                                         [tokenizer_char_classes[static_cast<unsigned char>(data[position])]];
+
+            if (actions & begin_line)
+                begin = position;
+            if (actions & end_token)
+                sink(token_span{token_begin, position - token_begin, token});
+            if (actions & end_token_before_backslash)
+                sink(token_span{token_begin, position - 1u - token_begin, token});
+            if (actions & begin_token)
+            {
+                token_begin = position;
+                token = token_kind::regular;
+            }
+            if (actions & begin_quoted)
+            {
+                token_begin = position + 1u;
+                token = next == state::double_quoted ? token_kind::double_quoted : token_kind::single_quoted;
+            }
+
+            current = next;
+            if (actions & end_line)
+                return position;
+            if (!(actions & reprocess))
+                position++;
+        }
+        return std::string_view::npos;
+    }
+
+    // the input ended without a terminator, flush the pending token.
+    // returns false if the input ends inside a quoted token.
+    template<typename Sink>
+    constexpr bool finish(Sink && sink)
+    {
+        switch (current)
+        {
+            case state::regular:
+            case state::regular_backslash:
+                sink(token_span{token_begin, position - token_begin, token});
+                return true;
+            case state::double_quoted:
+            case state::double_quoted_escape:
+            case state::single_quoted:
+            case state::single_quoted_escape:
+                return false;
+            default:
+                return true;
+        }
+    }
+
+    constexpr void reset() {*this = line_tokenizer{};}
+
+  private:
+    static std::uint64_t stops_(state st, const structural_masks & m)
+    {
+        switch (st)
+        {
+            case state::leading_whitespace:
+            case state::after_comment:      return m.valid & ~(m.space | m.line_break);
+            case state::between_tokens:
+            case state::line_extension:     return m.valid & ~m.space;
+            case state::regular:            return m.space | m.line_break | m.semi_colon
+                                                 | m.double_quote | m.single_quote | m.backslash;
+            case state::double_quoted:      return m.double_quote | m.backslash;
+            case state::single_quoted:      return m.single_quote | m.backslash;
+            case state::comment:
+            case state::trailing_comment:   return m.line_break;
+            default:                        return m.valid;
+        }
+    }
+};
+
 constexpr std::pair<std::string_view, std::string_view> pick_line(std::string_view raw)
 {
-    auto ln = line_matcher(raw);
-    if (!ln)
+    line_tokenizer tk;
+    const auto end = tk.scan(raw, [](token_span) {});
+    if (end == std::string_view::npos)
         return {"", raw};
     else
-        return {get<1>(ln).view(), raw.substr(ln.size())};
+        return {raw.substr(tk.begin, end - tk.begin), raw.substr(end + 1)};
 }
 
-constexpr auto tokenizer = ctre::tokenize<R"rx("((?:[^"\\]|\\.)*)"|'((?:[^'\\]|\\.)*)'|#([^\n]*)\n|(\\)|(;)|(\n)|([^\s"']+)|(\s+))rx">;
+// Tokens as 32 bit offsets & lengths relative to a base pointer plus their kind, stored in parallel arrays.
+// The first InlineSize tokens are stored in place, so typical lines don't allocate.
+// Elements are accessed as string_views.
+template<std::size_t InlineSize = 16u>
+struct basic_token_list
+{
+    struct iterator
+    {
+        using iterator_concept  = std::random_access_iterator_tag;
+        using iterator_category = std::input_iterator_tag;
+        using value_type        = std::string_view;
+        using reference         = std::string_view;
+        using difference_type   = std::ptrdiff_t;
+
+        const basic_token_list * list = nullptr;
+        std::size_t index = 0u;
+
+        std::string_view operator*() const {return (*list)[index];}
+        std::string_view operator[](difference_type n) const {return (*list)[index + n];}
+
+        iterator & operator++()    {index++; return *this;}
+        iterator   operator++(int) {auto tmp = *this; index++; return tmp;}
+        iterator & operator--()    {index--; return *this;}
+        iterator   operator--(int) {auto tmp = *this; index--; return tmp;}
+        iterator & operator+=(difference_type n) {index += n; return *this;}
+        iterator & operator-=(difference_type n) {index -= n; return *this;}
+
+        friend iterator operator+(iterator itr, difference_type n) {return itr += n;}
+        friend iterator operator+(difference_type n, iterator itr) {return itr += n;}
+        friend iterator operator-(iterator itr, difference_type n) {return itr -= n;}
+        friend difference_type operator-(const iterator & lhs, const iterator & rhs)
+        {
+            return static_cast<difference_type>(lhs.index) - static_cast<difference_type>(rhs.index);
+        }
+        friend bool operator==(const iterator & lhs, const iterator & rhs) {return lhs.index == rhs.index;}
+        friend auto operator<=>(const iterator & lhs, const iterator & rhs) {return lhs.index <=> rhs.index;}
+    };
+    using const_iterator = iterator;
+    using value_type = std::string_view;
+    using size_type = std::size_t;
+
+    basic_token_list() = default;
+    explicit basic_token_list(const char * base,
+                              std::pmr::memory_resource * resource = std::pmr::get_default_resource())
+        : base_(base), overflow_offsets_(resource), overflow_lengths_(resource), overflow_kinds_(resource)
+    {
+    }
+    // copy, but allocate the overflow from `resource`.
+    basic_token_list(const basic_token_list & other, std::pmr::memory_resource * resource)
+        : base_(other.base_), size_(other.size_),
+          offsets_(other.offsets_), lengths_(other.lengths_), kinds_(other.kinds_),
+          overflow_offsets_(other.overflow_offsets_, resource),
+          overflow_lengths_(other.overflow_lengths_, resource),
+          overflow_kinds_(other.overflow_kinds_, resource)
+    {
+    }
+    basic_token_list(const basic_token_list & other) = default;
+    basic_token_list(basic_token_list && other) noexcept = default;
+    basic_token_list & operator=(const basic_token_list & other) = default;
+    basic_token_list & operator=(basic_token_list && other) noexcept = default;
+
+    std::size_t size() const {return size_;}
+    bool empty() const {return size_ == 0u;}
+
+    std::string_view operator[](std::size_t i) const
+    {
+        if (i < InlineSize)
+            return {base_ + offsets_[i], lengths_[i]};
+        else
+            return {base_ + overflow_offsets_[i - InlineSize], overflow_lengths_[i - InlineSize]};
+    }
+    token_kind kind(std::size_t i) const {return i < InlineSize ? kinds_[i] : overflow_kinds_[i - InlineSize];}
+
+    std::string_view front() const {return (*this)[0u];}
+    std::string_view back()  const {return (*this)[size_ - 1u];}
+
+    iterator begin() const {return {this, 0u};}
+    iterator end()   const {return {this, size_};}
+
+    // offset relative to the base pointer.
+    void push_back(std::size_t offset, std::size_t length, token_kind kind = token_kind::regular)
+    {
+        if (size_ < InlineSize)
+        {
+            offsets_[size_] = static_cast<std::uint32_t>(offset);
+            lengths_[size_] = static_cast<std::uint32_t>(length);
+            kinds_[size_]   = kind;
+        }
+        else
+        {
+            overflow_offsets_.push_back(static_cast<std::uint32_t>(offset));
+            overflow_lengths_.push_back(static_cast<std::uint32_t>(length));
+            overflow_kinds_.push_back(kind);
+        }
+        size_++;
+    }
+    // the token needs to point into the memory after the base pointer.
+    void push_back(std::string_view token, token_kind kind = token_kind::regular)
+    {
+        push_back(static_cast<std::size_t>(token.data() - base_), token.size(), kind);
+    }
+
+    const char * base() const {return base_;}
+    // move all tokens along with the data they point to.
+    void set_base(const char * base) {base_ = base;}
+
+    void clear()
+    {
+        size_ = 0u;
+        overflow_offsets_.clear();
+        overflow_lengths_.clear();
+        overflow_kinds_.clear();
+    }
+
+    template<typename Range>
+        requires std::convertible_to<std::ranges::range_reference_t<const Range &>, std::string_view>
+    friend bool operator==(const basic_token_list & lhs, const Range & rhs)
+    {
+        return std::ranges::equal(lhs, rhs);
+    }
+
+  private:
+    const char * base_ = nullptr;
+    std::uint32_t size_ = 0u;
+    std::array<std::uint32_t, InlineSize> offsets_{};
+    std::array<std::uint32_t, InlineSize> lengths_{};
+    std::array<token_kind, InlineSize> kinds_{};
+    std::pmr::vector<std::uint32_t> overflow_offsets_;
+    std::pmr::vector<std::uint32_t> overflow_lengths_;
+    std::pmr::vector<token_kind> overflow_kinds_;
+};
+
+using token_list = basic_token_list<>;
 
 struct tokenized_view
 {
     std::string_view raw_input;
-    std::vector<std::string_view> tokens;
+    token_list tokens;
 };
 
-inline std::pair<tokenized_view, std::string_view> tokenize(std::string_view raw, bool skip_ws = true)
+namespace detail
+{
+
+// the regex based tokenizer, which can also report whitespace, comments & separators.
+inline std::pair<tokenized_view, std::string_view> tokenize_all(std::string_view raw)
 {
     /*
      regexes:
@@ -58,17 +513,14 @@ inline std::pair<tokenized_view, std::string_view> tokenize(std::string_view raw
         whitespace: (\s+)
      */
     std::size_t offset{0u};
-    tokenized_view res;
+    tokenized_view res{.raw_input = {}, .tokens = token_list{raw.data()}};
     for (auto tk : tokenizer(raw))
     {
         auto & [full, double_quoted, single_quoted, comment, line_extension, semi_colon, line_break, regular, whitespace] = tk;
         offset += full.size();
 
-        if (skip_ws && (comment || line_extension || semi_colon || line_break || whitespace))
-            continue;
-
-        if(double_quoted) res.tokens.push_back(double_quoted.view());
-        else if(single_quoted) res.tokens.push_back(single_quoted.view());
+        if(double_quoted) res.tokens.push_back(double_quoted.view(), token_kind::double_quoted);
+        else if(single_quoted) res.tokens.push_back(single_quoted.view(), token_kind::single_quoted);
         else if(comment) res.tokens.push_back(comment.view());
         else if(line_extension) res.tokens.push_back(line_extension.view());
         else if(semi_colon) res.tokens.push_back(semi_colon.view());
@@ -82,4 +534,38 @@ inline std::pair<tokenized_view, std::string_view> tokenize(std::string_view raw
 
 }
 
+// tokenize the first line in raw, i.e. up to its `;` or line break, & return the rest after the terminator,
+// so consecutive calls go through the input line by line, like pick_line.
+// This used to tokenize all of raw into one list, which is what skip_ws = false still does, whitespace, comments
+// & separators included.
+// If the input ends in an unterminated quote, the rest starts at that quote.
+inline std::pair<tokenized_view, std::string_view> tokenize(std::string_view raw, bool skip_ws = true)
+{
+    if (!skip_ws)
+        return detail::tokenize_all(raw);
+
+    tokenized_view res{.raw_input = {}, .tokens = token_list{raw.data()}};
+    line_tokenizer tk;
+    auto sink = [&](token_span sp) {res.tokens.push_back(sp.offset, sp.length, sp.kind);};
+    if (const auto end = tk.scan(raw, sink); end != std::string_view::npos)
+    {
+        res.raw_input = raw.substr(tk.begin, end - tk.begin);
+        return {std::move(res), raw.substr(end + 1)};
+    }
+
+    if (tk.current == line_tokenizer::state::leading_whitespace)
+        return {std::move(res), ""};
+    else if (tk.finish(sink))
+    {
+        res.raw_input = raw.substr(tk.begin);
+        return {std::move(res), ""};
+    }
+
+    const auto quote = tk.token_begin - 1u;
+    res.raw_input = raw.substr(tk.begin, quote - tk.begin);
+    return {std::move(res), raw.substr(quote)};
+}
+
+}
+
 #endif //ASH_TOKENIZER_HPP
@@ -0,0 +1,338 @@
+#ifndef ASH_URING_HPP
+#define ASH_URING_HPP
+
+#if defined(ASH_HAS_IO_URING)
+
+#include <ash/config.hpp>
+
+#if defined(BOOST_CAMPBELL)
+#include <boost/asio/experimental/channel.hpp>
+#include <boost/asio/posix/stream_descriptor.hpp>
+#else
+#include <asio/experimental/channel.hpp>
+#include <asio/posix/stream_descriptor.hpp>
+#endif
+
+#include <liburing.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string_view>
+#include <system_error>
+#include <unordered_map>
+
+namespace ash
+{
+
+struct uring_completion
+{
+    int res;
+    unsigned flags;
+};
+
+// An operation submitted to the ring; completions get delivered in order through the channel on the operation's executor.
+// The channel isn't thread safe, so the executor needs to be a strand if the context is run by more than one thread.
+struct uring_operation
+{
+    using channel_type = net::experimental::channel<void(std::error_code, uring_completion)>;
+
+    uring_operation(net::any_io_executor exec, int fd, std::size_t max_pending)
+        : completions(std::move(exec), max_pending), fd(fd), socket(is_socket_(fd)) {}
+
+    channel_type completions;
+    int fd;
+    bool socket;
+    // a multishot operation is still producing completions; kept by the consumer of the channel.
+    bool armed = false;
+
+  private:
+    friend struct uring_context;
+    // completions that aren't in the channel yet & whether they're being delivered; guarded by the ring's mutex.
+    std::deque<uring_completion> pending_;
+    bool delivering_ = false;
+
+    static bool is_socket_(int fd)
+    {
+        struct stat st;
+        return ::fstat(fd, &st) == 0 && S_ISSOCK(st.st_mode);
+    }
+};
+
+// One io_uring per execution context, shared by all sessions running on it.
+// Reads use a ring of provided buffers, so an idle session doesn't own any memory
+// and an armed multishot recv needs no syscall per read.
+// Completions get picked up when the ring's eventfd becomes readable, so the regular reactor drives it;
+// it's only waited on while there are operations in flight, so the context can run out of work.
+struct uring_context final : net::execution_context::service
+{
+    constexpr static unsigned ring_entries   = 1024u;
+    constexpr static unsigned buffer_count   = 1024u; // must be a power of two
+    constexpr static unsigned buffer_size    = 4096u;
+    constexpr static int      buffer_group   = 0;
+
+    static inline net::execution_context::id id;
+
+    explicit uring_context(net::execution_context & ctx) : net::execution_context::service(ctx)
+    {
+        if (auto res = io_uring_queue_init(ring_entries, &ring_, 0); res < 0)
+            throw std::system_error(-res, std::system_category(), "io_uring_queue_init");
+
+        int res = 0;
+        buffer_ring_ = io_uring_setup_buf_ring(&ring_, buffer_count, buffer_group, 0, &res);
+        if (buffer_ring_ == nullptr)
+        {
+            io_uring_queue_exit(&ring_);
+            throw std::system_error(-res, std::system_category(), "io_uring_setup_buf_ring");
+        }
+        buffers_ = std::make_unique_for_overwrite<char[]>(std::size_t{buffer_count} * buffer_size);
+        for (unsigned i = 0u; i < buffer_count; i++)
+            io_uring_buf_ring_add(buffer_ring_, buffers_.get() + std::size_t{i} * buffer_size, buffer_size,
+                                  static_cast<unsigned short>(i), io_uring_buf_ring_mask(buffer_count),
+                                  static_cast<int>(i));
+        io_uring_buf_ring_advance(buffer_ring_, static_cast<int>(buffer_count));
+    }
+
+    ~uring_context()
+    {
+        io_uring_free_buf_ring(&ring_, buffer_ring_, buffer_count, buffer_group);
+        io_uring_queue_exit(&ring_);
+    }
+
+    // get the ring of the executor's context & make sure it's being polled.
+    template<typename Executor>
+    static uring_context & use(const Executor & exec)
+    {
+        auto & res = net::use_service<uring_context>(net::query(exec, net::execution::context));
+        res.start_(exec);
+        return res;
+    }
+
+    // operations on fd, completing on exec.
+    std::shared_ptr<uring_operation> make_operation(net::any_io_executor exec, int fd)
+    {
+        return std::make_shared<uring_operation>(std::move(exec), fd, buffer_count);
+    }
+
+    // keeps producing completions with a provided buffer each, until it fails or runs out of buffers.
+    void read_multishot(const std::shared_ptr<uring_operation> & op)
+    {
+        std::lock_guard<std::mutex> lock{mutex_};
+        auto sqe = get_sqe_();
+        if (op->socket)
+            io_uring_prep_recv_multishot(sqe, op->fd, nullptr, 0u, 0);
+        else
+            io_uring_prep_read_multishot(sqe, op->fd, 0u, static_cast<__u64>(-1), buffer_group);
+        sqe->flags |= IOSQE_BUFFER_SELECT;
+        sqe->buf_group = buffer_group;
+        submit_(sqe, op);
+        op->armed = true;
+    }
+
+    void write(const std::shared_ptr<uring_operation> & op, std::string_view data)
+    {
+        std::lock_guard<std::mutex> lock{mutex_};
+        auto sqe = get_sqe_();
+        if (op->socket)
+            io_uring_prep_send(sqe, op->fd, data.data(), data.size(), MSG_NOSIGNAL);
+        else
+            io_uring_prep_write(sqe, op->fd, data.data(), static_cast<unsigned>(data.size()), static_cast<__u64>(-1));
+        submit_(sqe, op);
+    }
+
+    void cancel(const std::shared_ptr<uring_operation> & op)
+    {
+        std::lock_guard<std::mutex> lock{mutex_};
+        auto sqe = get_sqe_();
+        io_uring_prep_cancel64(sqe, key_(op), 0);
+        io_uring_sqe_set_data64(sqe, 0u);
+        io_uring_submit(&ring_);
+    }
+
+    // the consumer is gone: stop the operation & give the buffers of everything it didn't get back to the kernel,
+    // including completions that are still on their way. Needs to run on the operation's executor.
+    void close(const std::shared_ptr<uring_operation> & op)
+    {
+        if (op->armed)
+            cancel(op);
+        while (op->completions.try_receive([this](std::error_code, uring_completion cp) {recycle(cp);}))
+            ;
+        op->completions.close();
+    }
+
+    // the bytes of a completed read.
+    std::string_view buffer(const uring_completion & cp) const
+    {
+        const auto bid = cp.flags >> IORING_CQE_BUFFER_SHIFT;
+        return {buffers_.get() + std::size_t{bid} * buffer_size, static_cast<std::size_t>(cp.res)};
+    }
+
+    // give the buffer of a completed read back to the kernel.
+    void recycle(const uring_completion & cp)
+    {
+        if ((cp.flags & IORING_CQE_F_BUFFER) == 0u)
+            return;
+        const auto bid = cp.flags >> IORING_CQE_BUFFER_SHIFT;
+        std::lock_guard<std::mutex> lock{mutex_};
+        io_uring_buf_ring_add(buffer_ring_, buffers_.get() + std::size_t{bid} * buffer_size, buffer_size,
+                              static_cast<unsigned short>(bid), io_uring_buf_ring_mask(buffer_count), 0);
+        io_uring_buf_ring_advance(buffer_ring_, 1);
+    }
+
+  private:
+    void shutdown() override
+    {
+        std::lock_guard<std::mutex> lock{mutex_};
+        if (eventfd_)
+            eventfd_->close();
+        operations_.clear();
+    }
+
+    template<typename Executor>
+    void start_(const Executor & exec)
+    {
+        std::lock_guard<std::mutex> lock{mutex_};
+        if (eventfd_)
+            return;
+
+        const auto fd = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (fd < 0)
+            throw std::system_error(errno, std::system_category(), "eventfd");
+        eventfd_.emplace(net::any_io_executor(exec), fd);
+        if (auto res = io_uring_register_eventfd(&ring_, fd); res < 0)
+            throw std::system_error(-res, std::system_category(), "io_uring_register_eventfd");
+    }
+
+    // needs the mutex.
+    void wait_()
+    {
+        waiting_ = true;
+        eventfd_->async_wait(net::posix::stream_descriptor::wait_read,
+                             [this](std::error_code ec)
+                             {
+                                 if (ec)
+                                     return;
+                                 std::uint64_t cnt;
+                                 [[maybe_unused]] auto _ = ::read(eventfd_->native_handle(), &cnt, sizeof(cnt));
+                                 std::lock_guard<std::mutex> lock{mutex_};
+                                 drain_();
+                                 if (operations_.empty())
+                                     waiting_ = false;
+                                 else
+                                     wait_();
+                             });
+    }
+
+    // queue the completions at their operations; needs the mutex.
+    void drain_()
+    {
+        io_uring_cqe * cqes[64];
+        while (auto n = io_uring_peek_batch_cqe(&ring_, cqes, 64u))
+        {
+            for (unsigned i = 0u; i < n; i++)
+            {
+                auto itr = operations_.find(cqes[i]->user_data);
+                if (itr == operations_.end())
+                    continue;
+
+                const uring_completion cp{cqes[i]->res, cqes[i]->flags};
+                auto & op = itr->second;
+                op->pending_.push_back(cp);
+                // one delivery per operation at a time, so the completions can't overtake each other.
+                if (!op->delivering_)
+                {
+                    op->delivering_ = true;
+                    net::post(op->completions.get_executor(), [this, op] {deliver_(op);});
+                }
+                if ((cp.flags & IORING_CQE_F_MORE) == 0u)
+                    operations_.erase(itr);
+            }
+            io_uring_cq_advance(&ring_, n);
+        }
+    }
+
+    // move the pending completions into the channel, on the operation's executor.
+    void deliver_(const std::shared_ptr<uring_operation> & op)
+    {
+        while (true)
+        {
+            uring_completion cp;
+            {
+                std::lock_guard<std::mutex> lock{mutex_};
+                if (op->pending_.empty())
+                {
+                    op->delivering_ = false;
+                    return;
+                }
+                cp = op->pending_.front();
+                op->pending_.pop_front();
+            }
+
+            if (op->completions.try_send(std::error_code{}, cp))
+                continue;
+            else if (!op->completions.is_open())
+                // nobody is going to read it.
+                recycle(cp);
+            else
+            {
+                // the channel is full; the rest waits until this one got in.
+                op->completions.async_send(std::error_code{}, cp,
+                                           [this, op, cp](std::error_code ec)
+                                           {
+                                               if (ec)
+                                                   recycle(cp);
+                                               deliver_(op);
+                                           });
+                return;
+            }
+        }
+    }
+
+    io_uring_sqe * get_sqe_()
+    {
+        auto sqe = io_uring_get_sqe(&ring_);
+        // the submission queue is full of operations nobody submitted yet.
+        if (sqe == nullptr)
+        {
+            io_uring_submit(&ring_);
+            sqe = io_uring_get_sqe(&ring_);
+        }
+        return sqe;
+    }
+
+    void submit_(io_uring_sqe * sqe, const std::shared_ptr<uring_operation> & op)
+    {
+        // the ring keeps the operation alive until its last completion.
+        io_uring_sqe_set_data64(sqe, key_(op));
+        operations_.emplace(key_(op), op);
+        io_uring_submit(&ring_);
+        if (!waiting_)
+            wait_();
+    }
+
+    static std::uint64_t key_(const std::shared_ptr<uring_operation> & op)
+    {
+        return reinterpret_cast<std::uintptr_t>(op.get());
+    }
+
+    std::mutex mutex_;
+    io_uring ring_;
+    io_uring_buf_ring * buffer_ring_ = nullptr;
+    std::unique_ptr<char[]> buffers_;
+    std::optional<net::posix::stream_descriptor> eventfd_;
+    bool waiting_ = false;
+    std::unordered_map<std::uint64_t, std::shared_ptr<uring_operation>> operations_;
+};
+
+}
+
+#endif
+
+#endif //ASH_URING_HPP
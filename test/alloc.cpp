@@ -0,0 +1,347 @@
+#include <doctest.h>
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdlib>
+#include <fstream>
+#include <memory>
+#include <memory_resource>
+#include <new>
+#include <span>
+#include <string>
+#include <vector>
+#include <sys/resource.h>
+#include <unistd.h>
+#include <ash/shell.hpp>
+
+namespace
+{
+
+std::atomic<std::size_t> allocations{0u};
+
+struct allocation_counter
+{
+    std::size_t start = allocations.load();
+    std::size_t count() const {return allocations.load() - start;}
+};
+
+}
+
+void * operator new(std::size_t size)
+{
+    allocations++;
+    if (auto p = std::malloc(size == 0u ? 1u : size))
+        return p;
+    throw std::bad_alloc();
+}
+
+void * operator new(std::size_t size, std::align_val_t align)
+{
+    allocations++;
+    const auto al = static_cast<std::size_t>(align);
+    if (auto p = std::aligned_alloc(al, (size + al - 1u) / al * al))
+        return p;
+    throw std::bad_alloc();
+}
+
+void * operator new[](std::size_t size) {return operator new(size);}
+void * operator new[](std::size_t size, std::align_val_t align) {return operator new(size, align);}
+void operator delete(void * p) noexcept {std::free(p);}
+void operator delete[](void * p) noexcept {std::free(p);}
+void operator delete(void * p, std::size_t) noexcept {std::free(p);}
+void operator delete[](void * p, std::size_t) noexcept {std::free(p);}
+void operator delete(void * p, std::align_val_t) noexcept {std::free(p);}
+void operator delete[](void * p, std::align_val_t) noexcept {std::free(p);}
+void operator delete(void * p, std::size_t, std::align_val_t) noexcept {std::free(p);}
+void operator delete[](void * p, std::size_t, std::align_val_t) noexcept {std::free(p);}
+
+namespace net = ash::net;
+
+namespace
+{
+
+constexpr std::size_t commands_per_chunk = 1000u;
+constexpr std::size_t rounds = 10u;
+
+// allocations we accept per command; the coroutine frames come from the frame_pool.
+constexpr std::size_t command_budget = 0u;
+
+std::string make_script(std::size_t n, bool long_lines = false)
+{
+    std::string res;
+    for (std::size_t i = 0u; i < n; i++)
+    {
+        res += "count " + std::to_string(i) + " 'quoted arg' \"another one\"";
+        if (long_lines && i % 10u == 0u)
+            for (int j = 0; j < 20; j++)
+                res += " extra";
+        res += '\n';
+    }
+    return res;
+}
+
+auto script_reader(net::any_io_executor, std::string_view script, std::size_t repeat) -> ash::chunk_reader
+{
+    for (std::size_t i = 0u; i < repeat; i++)
+        co_yield script;
+}
+
+auto discard_writer(net::any_io_executor, std::size_t & written, std::string_view msg = "") -> ash::chunk_writer
+{
+    while (true)
+    {
+        written += msg.size();
+        msg = co_yield msg.size();
+    }
+}
+
+auto write_n(net::any_io_executor, ash::chunk_writer & writer, std::size_t n, std::size_t & allocs)
+    -> net::experimental::coro<void>
+{
+    co_await writer("warmup\n");
+    allocation_counter cnt;
+    for (std::size_t i = 0u; i < n; i++)
+        co_await writer("some output line\n");
+    allocs = cnt.count();
+}
+
+// what the process has in memory, in bytes.
+std::size_t resident_bytes()
+{
+    std::ifstream statm{"/proc/self/statm"};
+    std::size_t size = 0u, resident = 0u;
+    statm >> size >> resident;
+    return resident * static_cast<std::size_t>(::sysconf(_SC_PAGESIZE));
+}
+
+}
+
+TEST_CASE("framing does not allocate")
+{
+    const auto script = make_script(commands_per_chunk);
+    ash::line_framer framer;
+    ash::reader_mode mode{ash::reader_mode::raw_line_t{}};
+
+    std::size_t lines = 0u, allocs = 0u;
+    for (std::size_t round = 0u; round <= rounds; round++)
+    {
+        allocation_counter cnt;
+        framer.feed(script);
+        while (framer.next(mode))
+            lines++;
+        framer.stash();
+        if (round > 0u)
+            allocs += cnt.count();
+    }
+
+    CHECK(lines == commands_per_chunk * (rounds + 1u));
+    MESSAGE("framing: ", static_cast<double>(allocs) / (commands_per_chunk * rounds), " allocations per command");
+    CHECK(allocs == 0u);
+}
+
+TEST_CASE("tokenizing does not allocate")
+{
+    const auto script = make_script(commands_per_chunk, true);
+    std::array<std::byte, 4096u> buffer;
+    std::pmr::monotonic_buffer_resource arena{buffer.data(), buffer.size()};
+    ash::line_framer framer;
+
+    std::size_t lines = 0u, allocs = 0u;
+    for (std::size_t round = 0u; round <= rounds; round++)
+    {
+        allocation_counter cnt;
+        // split the script, so lines get carried over between chunks.
+        for (auto chunk : {std::string_view(script).substr(0u, script.size() / 3u),
+                           std::string_view(script).substr(script.size() / 3u)})
+        {
+            framer.feed(chunk);
+            ash::reader_mode mode{ash::reader_mode::tokenize_t{&arena}};
+            while (auto ln = framer.next(mode))
+            {
+                CHECK(ln->tokens.size() >= 4u);
+                lines++;
+                arena.release();
+            }
+            framer.stash();
+        }
+        if (round > 0u)
+            allocs += cnt.count();
+    }
+
+    CHECK(lines == commands_per_chunk * (rounds + 1u));
+    MESSAGE("tokenizing: ", static_cast<double>(allocs) / (commands_per_chunk * rounds), " allocations per command");
+    CHECK(allocs == 0u);
+}
+
+TEST_CASE("writing does not allocate")
+{
+    net::io_context ctx;
+    std::size_t written = 0u, allocs = 0u;
+    auto writer = discard_writer(ctx.get_executor(), written);
+    auto task = write_n(ctx.get_executor(), writer, commands_per_chunk, allocs);
+    task.async_resume(net::detached);
+    ctx.run();
+
+    MESSAGE("writing: ", static_cast<double>(allocs) / commands_per_chunk, " allocations per write");
+    CHECK(allocs == 0u);
+}
+
+TEST_CASE("sessions share the command registry")
+{
+    std::vector<ash::cmd> cmds;
+    for (std::size_t i = 0u; i < 2000u; i++)
+        cmds.push_back({.name = "cmd" + std::to_string(i), .help = "does something",
+                        .children = {{.name = "sub", .help = "does something else"}}});
+    const ash::command_set cmd_set{std::make_shared<const ash::command_registry>(std::move(cmds))};
+
+    allocation_counter cnt;
+    std::vector<ash::command_set> sessions(10000u, cmd_set);
+    const auto allocs = cnt.count();
+
+    MESSAGE("sessions: ", allocs, " allocations for ", sessions.size(), " command sets");
+    // just the vector itself.
+    CHECK(allocs == 1u);
+    CHECK(sessions.back().registry() == cmd_set.registry());
+    CHECK(cmd_set.registry().use_count() == 10001);
+}
+
+TEST_CASE("shell steady state")
+{
+    net::io_context ctx;
+    const auto script = make_script(commands_per_chunk);
+
+    std::size_t written = 0u, invocations = 0u, steady_allocs = 0u;
+    std::size_t last = 0u;
+
+    ash::shell sh{script_reader(ctx.get_executor(), script, rounds),
+                  discard_writer(ctx.get_executor(), written),
+                  {ash::cmd{
+                    .name = "count",
+                    .run = [&](ash::context ctx) -> ash::cmd_task
+                    {
+                        const auto now = allocations.load();
+                        // skip the first chunk, to let the buffers grow to their size.
+                        if (invocations++ > commands_per_chunk)
+                            steady_allocs += now - last;
+                        last = now;
+                        co_await ctx.write(ctx.args.front());
+                    }}}};
+
+    auto frame_pool = ash::frame_pool::local();
+    REQUIRE(frame_pool != nullptr);
+    frame_pool->reset_stats();
+    sh.async_run(net::detached);
+    ctx.run();
+
+    REQUIRE(invocations == commands_per_chunk * rounds);
+    const auto & frames = frame_pool->stats();
+    MESSAGE("frames: ", static_cast<double>(frames.allocations) / invocations, " per command, ",
+            frames.allocations - frames.reused, " not recycled, largest is ", frames.largest, " bytes");
+    for (std::size_t i = 0u; i < ash::frame_pool::class_count; i++)
+        if (frames.sizes[i] > 0u)
+            MESSAGE("  ", frames.sizes[i], " frames of up to ", (i + 1u) * ash::frame_pool::granularity, " bytes");
+    CHECK(frames.sizes.back() == 0u);
+    const auto measured = invocations - commands_per_chunk - 1u;
+    const auto per_command = static_cast<double>(steady_allocs) / measured;
+    MESSAGE("shell: ", per_command, " allocations per command, budget is ", command_budget);
+    CHECK(written > 0u);
+    CHECK(steady_allocs <= command_budget * measured);
+}
+
+TEST_CASE("dispatch does not allocate")
+{
+    net::io_context ctx;
+    std::size_t written = 0u, sync_args = 0u;
+    const ash::command_set cmds{
+        ash::cmd{.name = "count", .run = [&](ash::context & ctx) {sync_args += ctx.args.size();}},
+        ash::cmd{.name = "wait",  .run = [](ash::context ctx) -> ash::cmd_task {co_await ctx.write(ctx.args.front());}}};
+    // only there for the context, it never runs.
+    ash::shell sh{script_reader(ctx.get_executor(), "", 0u), discard_writer(ctx.get_executor(), written), cmds};
+
+    std::string script;
+    for (std::size_t i = 0u; i < commands_per_chunk; i++)
+        script += (i % 2u == 0u ? "count " : "wait ") + std::to_string(i) + " 'quoted arg' \"another one\"\n";
+
+    std::array<std::byte, 4096u> buffer;
+    std::pmr::monotonic_buffer_resource arena{buffer.data(), buffer.size()};
+    std::array<std::string_view, 16u> args;
+    ash::line_framer framer;
+    framer.feed(script);
+    ash::reader_mode mode{ash::reader_mode::tokenize_t{&arena}};
+
+    std::size_t dispatched = 0u, allocs = 0u;
+    while (auto ln = framer.next(mode))
+    {
+        auto raw = ln->raw_input;
+        allocation_counter cnt;
+        if (auto cd = cmds.find(ln->tokens.begin(), ln->tokens.end()))
+        {
+            const auto n = (std::min)(ln->tokens.size() - cd.depth, args.size());
+            std::copy_n(ln->tokens.begin() + cd.depth, n, args.begin());
+            ash::context c{std::span<const std::string_view>{args.data(), n}, raw, ln->tokens, sh};
+            if (cd.is_sync())
+                cd.run_inline(c);
+            else
+                // the frame comes from the frame_pool & goes back to it, without running.
+                cd(c);
+            dispatched++;
+        }
+        // the first of each kind warms up the frame_pool.
+        if (dispatched > 2u)
+            allocs += cnt.count();
+        arena.release();
+    }
+
+    REQUIRE(dispatched == commands_per_chunk);
+    CHECK(sync_args == commands_per_chunk / 2u * 4u);
+    MESSAGE("dispatch: ", static_cast<double>(allocs) / (dispatched - 2u), " allocations per command, budget is ",
+            command_budget);
+    CHECK(allocs <= command_budget * (dispatched - 2u));
+}
+
+TEST_CASE("idle sessions' resident memory")
+{
+    // both ends of every session live in this process.
+    rlimit lim{};
+    REQUIRE(::getrlimit(RLIMIT_NOFILE, &lim) == 0);
+    lim.rlim_cur = lim.rlim_max;
+    ::setrlimit(RLIMIT_NOFILE, &lim);
+    ::getrlimit(RLIMIT_NOFILE, &lim);
+    const auto sessions = std::clamp<std::size_t>((lim.rlim_cur - 64u) / 2u, 16u, 4000u);
+
+    using socket = net::local::stream_protocol::socket;
+    net::io_context ctx;
+    const ash::command_set cmds{{ash::cmd{.name = "ping",
+                                          .run = [](ash::context ctx) -> ash::cmd_task {co_await ctx.write("pong\n");}}}};
+    std::vector<std::unique_ptr<socket>> clients, servers;
+    std::vector<std::unique_ptr<ash::shell>> shells;
+    clients.reserve(sessions);
+    servers.reserve(sessions);
+    shells.reserve(sessions);
+
+    const auto before = resident_bytes();
+    for (std::size_t i = 0u; i < sessions; i++)
+    {
+        clients.push_back(std::make_unique<socket>(ctx));
+        servers.push_back(std::make_unique<socket>(ctx));
+        net::local::connect_pair(*clients.back(), *servers.back());
+        shells.push_back(std::make_unique<ash::shell>(*servers.back(), cmds));
+        shells.back()->async_run(net::detached);
+    }
+    // every session runs a command & then waits for the next one.
+    for (auto & c : clients)
+        net::write(*c, net::buffer(std::string_view{"ping 'an argument that is a bit longer' \"quoted\" # idle now\n"}));
+    while (ctx.poll() > 0u)
+        ;
+    const auto per_session = (resident_bytes() - before) / sessions;
+
+    MESSAGE(sessions, " idle sessions: ", per_session, " resident bytes each, the shell itself is ",
+            sizeof(ash::shell), " bytes");
+    // the frame & read buffers went back to the pools, what's left is the shell & its coroutines.
+    CHECK(per_session < 4u * sizeof(ash::shell));
+
+    // let the sessions end, before the sockets go.
+    for (auto & c : clients)
+        c->close();
+    ctx.run();
+}
@@ -0,0 +1,133 @@
+#include <doctest.h>
+#include <chrono>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <ash/tokenizer.hpp>
+
+namespace
+{
+
+// what a script or a replayed log sends.
+std::string command_log(std::size_t n)
+{
+    std::string res;
+    for (std::size_t i = 0u; i < n; i++)
+        res += "set metric.subsystem.value" + std::to_string(i) + " 42; get 'quoted value with spaces' --format json\n";
+    return res;
+}
+
+// long quoted arguments full of escapes & continued lines, that make the regexes backtrack.
+std::string escape_heavy(std::size_t n)
+{
+    std::string res;
+    for (std::size_t i = 0u; i < n; i++)
+    {
+        res += "upload \"";
+        for (int j = 0; j < 200; j++)
+            res += "a\\\"b\\\\ ";
+        res += "\" \\\n  --to 'some where'\n";
+    }
+    return res;
+}
+
+// random characters out of the grammar.
+std::string mixed_input(std::size_t n, unsigned seed)
+{
+    constexpr std::string_view alphabet = "ab \t\n;\"'\\#\r\v\f";
+    std::string res;
+    for (std::size_t i = 0u; i < n; i++)
+    {
+        seed = seed * 1103515245u + 12345u;
+        res += alphabet[(seed >> 16u) % alphabet.size()];
+    }
+    return res;
+}
+
+struct scan_result
+{
+    std::size_t lines = 0u;
+    std::size_t tokens = 0u;
+    double mb_per_s = 0.0;
+};
+
+// runs `scan` over the data, which returns how many bytes it got through.
+template<typename Scan>
+scan_result measure(std::string_view data, Scan scan)
+{
+    scan_result res;
+    const auto start = std::chrono::steady_clock::now();
+    const auto consumed = scan(data, res);
+    const auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    res.mb_per_s = static_cast<double>(consumed) / elapsed / 1e6;
+    return res;
+}
+
+// the bitmask driven state machine.
+std::size_t scan_line_tokenizer(std::string_view data, scan_result & res)
+{
+    const auto size = data.size();
+    ash::line_tokenizer tk;
+    std::size_t tokens = 0u;
+    while (true)
+    {
+        const auto end = tk.scan(data, [&](ash::token_span) {tokens++;});
+        if (end == std::string_view::npos)
+            break;
+        res.lines++;
+        res.tokens += std::exchange(tokens, 0u);
+        data.remove_prefix(end + 1u);
+        tk.reset();
+    }
+    return size - data.size();
+}
+
+// the regexes: line_matcher picks the line, the ctre tokenizer splits it.
+std::size_t scan_ctre(std::string_view data, scan_result & res)
+{
+    const auto size = data.size();
+    while (auto ln = ash::line_matcher(data))
+    {
+        for (auto tk : ash::tokenizer(get<1>(ln).view()))
+        {
+            auto & [full, double_quoted, single_quoted, comment, line_extension, semi_colon, line_break, regular, whitespace] = tk;
+            if (double_quoted || single_quoted || regular)
+                res.tokens++;
+        }
+        res.lines++;
+        data.remove_prefix(ln.size());
+    }
+    return size - data.size();
+}
+
+}
+
+TEST_CASE("line_tokenizer against the ctre line_matcher & tokenizer")
+{
+    struct input
+    {
+        std::string_view name;
+        std::string data;
+        // the grammars only differ in comments & unterminated quotes.
+        bool same_lines;
+    };
+    const input inputs[] = {
+        {"command log", command_log(200000u), true},
+        {"escape heavy", escape_heavy(5000u), true},
+        {"mixed characters", mixed_input(20u * 1024u * 1024u, 3u), false},
+    };
+
+    for (const auto & in : inputs)
+    {
+        const auto simd = measure(in.data, scan_line_tokenizer);
+        const auto regex = measure(in.data, scan_ctre);
+        MESSAGE(in.name, " (", in.data.size() / 1024u, " KiB): line_tokenizer ", simd.mb_per_s, " MB/s, ",
+                simd.lines, " lines, ", simd.tokens, " tokens; ctre ", regex.mb_per_s, " MB/s, ",
+                regex.lines, " lines, ", regex.tokens, " tokens");
+        if (in.same_lines)
+        {
+            CHECK(simd.lines == regex.lines);
+            CHECK(simd.tokens == regex.tokens);
+        }
+    }
+}
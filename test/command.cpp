@@ -0,0 +1,236 @@
+#include <doctest.h>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+#include <ash/shell.hpp>
+
+namespace
+{
+
+std::vector<ash::cmd> make_commands(std::size_t n)
+{
+    std::vector<ash::cmd> res;
+    res.reserve(n);
+    for (std::size_t i = 0u; i < n; i++)
+    {
+        ash::cmd c{.name = "metric" + std::to_string(i), .aliases = {"m" + std::to_string(i)}};
+        if (i % 10u == 0u)
+            for (auto sub : {"get", "set", "reset"})
+                c.children.push_back({.name = sub, .aliases = {std::string(1u, sub[0])}});
+        res.push_back(std::move(c));
+    }
+    return res;
+}
+
+auto noop(ash::context) -> ash::cmd_task
+{
+    co_return;
+}
+
+constexpr std::array static_commands{
+    ash::static_cmd{.name = "reboot",   .run = noop, .help = "reboot the device", .description = "after syncing the disks"},
+    ash::static_cmd{.name = "status",   .run = noop, .help = "print the status"},
+    ash::static_cmd{.name = "log",      .run = noop, .help = "print the log"},
+    ash::static_cmd{.name = "set",      .run = noop, .help = "set a parameter"},
+    ash::static_cmd{.name = "get",      .run = noop, .help = "get a parameter"},
+    ash::static_cmd{.name = "reset",    .run = noop, .help = "reset a parameter"},
+    ash::static_cmd{.name = "version",  .run = noop, .help = "print the firmware version"},
+    ash::static_cmd{.name = "shutdown", .run = noop, .help = "power off"},
+    ash::static_cmd{.name = "ping",     .run = noop, .help = "ping a host"},
+};
+
+using static_table = ash::static_command_table<static_commands>;
+
+constexpr std::array sync_commands{
+    ash::static_cmd{.name = "uptime", .run = [](ash::context & ctx) {ctx.output() += "42s\n";}, .help = "print the uptime"},
+    ash::static_cmd{.name = "whoami", .run = [](ash::context &) {return std::string("root\n");}, .help = "print the user"},
+};
+
+using sync_table = ash::static_command_table<sync_commands>;
+
+// everything but the dispatch itself happens at compile time.
+static_assert(static_table::find("reboot") == &static_commands[0]);
+static_assert(static_table::find("ping") == &static_commands[8]);
+static_assert(static_table::find("pong") == nullptr);
+static_assert(static_table::find("") == nullptr);
+static_assert(static_table::help("reboot") == "reboot the device\n   after syncing the disks\n\n");
+static_assert(static_table::help("status") == "print the status\n   \n\n");
+static_assert(static_table::help().ends_with("\n    - ping\n        ping a host\n"));
+
+static_assert(!static_table::find("reboot")->run.is_sync());
+static_assert(sync_table::find("uptime")->run.is_sync());
+static_assert(sync_table::find("whoami")->run.is_sync());
+// an empty handler runs neither way.
+static_assert(!ash::static_cmd{}.run.is_sync());
+
+template<typename Lookup>
+double ns_per_lookup(std::size_t n, Lookup && lookup)
+{
+    const auto start = std::chrono::steady_clock::now();
+    for (std::size_t i = 0u; i < n; i++)
+        lookup(i);
+    return static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now() - start).count()) / static_cast<double>(n);
+}
+
+}
+
+TEST_CASE("command_index matches find_command")
+{
+    const std::vector<ash::cmd> cmds{
+        {.name = "show", .aliases = {"s", "display"},
+         .children = {{.name = "config", .aliases = {"cfg"}, .children = {{.name = "all"}}},
+                      {.name = "log"}}},
+        {.name = "set"},
+        // shadowed by the alias of show.
+        {.name = "s"}};
+    const ash::command_index index{cmds};
+
+    const std::vector<std::vector<std::string_view>> lines{
+        {}, {"show"}, {"s"}, {"display", "cfg"}, {"show", "config", "all", "extra"}, {"show", "log", "all"},
+        {"show", "unknown"}, {"set", "config"}, {"unknown", "show"}, {"config"}};
+
+    for (const auto & ln : lines)
+    {
+        const auto expected = ash::find_command(ln.begin(), ln.end(), cmds);
+        const auto found = index.find(ln.begin(), ln.end());
+        CHECK(found.first == expected.first);
+        CHECK(found.second == expected.second);
+    }
+    CHECK(index.find(lines[4].begin(), lines[4].end()).first == &cmds[0].children[0].children[0]);
+    CHECK(index.find(lines[4].begin(), lines[4].end()).second == 3u);
+}
+
+TEST_CASE("static_command_table dispatches like a registry")
+{
+    std::vector<ash::cmd> cmds;
+    for (auto & c : static_commands)
+        cmds.push_back({.name = std::string(c.name), .run = c.run,
+                        .help = std::string(c.help), .description = std::string(c.description)});
+    const ash::command_set dynamic{cmds}, fixed{static_table{}};
+
+    for (auto name : {"reboot", "status", "log", "set", "get", "reset", "version", "shutdown", "ping", "pong", "re"})
+    {
+        std::string line = std::string(name) + " arg\n";
+        ash::token_list tokens{line.data()};
+        tokens.push_back(0u, line.find(' '));
+        tokens.push_back(line.find(' ') + 1u, 3u);
+
+        const auto d = dynamic.find(tokens.begin(), tokens.end());
+        const auto f = fixed.find(tokens.begin(), tokens.end());
+        CHECK(static_cast<bool>(d) == static_cast<bool>(f));
+        CHECK(d.depth == f.depth);
+
+        std::string dynamic_help, fixed_help;
+        dynamic.help(tokens.begin(), std::next(tokens.begin()), dynamic_help);
+        fixed.help(tokens.begin(), std::next(tokens.begin()), fixed_help);
+        CHECK(dynamic_help == fixed_help);
+    }
+
+    std::string dynamic_help, fixed_help;
+    ash::token_list none;
+    dynamic.help(none.begin(), none.end(), dynamic_help);
+    fixed.help(none.begin(), none.end(), fixed_help);
+    CHECK(dynamic_help == fixed_help);
+}
+
+TEST_CASE("command_index lookup doesn't depend on the number of commands")
+{
+    for (std::size_t n : {10u, 1000u, 100000u})
+    {
+        const auto cmds = make_commands(n);
+        const ash::command_index index{cmds};
+
+        std::vector<std::vector<std::string>> lines;
+        for (std::size_t i = 0u; i < n; i++)
+            lines.push_back({i % 2u ? cmds[i].name : cmds[i].aliases.front(), i % 10u == 0u ? "r" : "arg"});
+
+        std::size_t found = 0u;
+        const auto indexed = ns_per_lookup(n, [&](std::size_t i)
+        {
+            auto [c, depth] = index.find(lines[i].begin(), lines[i].end());
+            found += (i % 10u == 0u ? c == &cmds[i].children[2] && depth == 2u : c == &cmds[i] && depth == 1u);
+        });
+        CHECK(found == n);
+
+        // the linear search is only sampled, 100k x 100k would take a while.
+        const auto samples = (std::min)(n, std::size_t{1000u});
+        std::size_t found_linear = 0u;
+        const auto linear = ns_per_lookup(samples, [&](std::size_t i)
+        {
+            const auto & ln = lines[i * (n / samples)];
+            found_linear += ash::find_command(ln.begin(), ln.end(), cmds).first != nullptr;
+        });
+        CHECK(found_linear == samples);
+        MESSAGE(n, " commands: ", indexed, " ns per indexed lookup, ", linear, " ns per linear lookup");
+    }
+}
+
+TEST_CASE("command_publisher updates while sessions dispatch")
+{
+    constexpr std::size_t dispatchers = 64u, updaters = 2u, updates = 500u, lookups = 20000u;
+
+    auto publisher = std::make_shared<ash::command_publisher>(std::vector<ash::cmd>{{.name = "base", .help = "always there"}});
+    std::weak_ptr<const ash::command_registry> first = publisher->snapshot();
+
+    std::atomic<std::size_t> base_missing{0u}, plugins_found{0u}, refreshes{0u};
+    {
+        std::vector<std::jthread> threads;
+        for (std::size_t t = 0u; t < updaters; t++)
+            threads.emplace_back([&, t]
+            {
+                for (std::size_t i = 0u; i < updates; i++)
+                {
+                    const auto name = "plugin" + std::to_string(t) + "_" + std::to_string(i);
+                    publisher->add({.name = name, .help = name});
+                    publisher->add({.name = "transient", .help = "comes and goes"});
+                    publisher->remove("transient");
+                }
+            });
+
+        for (std::size_t t = 0u; t < dispatchers; t++)
+            threads.emplace_back([&]
+            {
+                ash::command_set session{publisher};
+                std::string line = "base transient plugin0_0";
+                ash::token_list tokens{line.data()};
+                tokens.push_back(0u, 4u);
+                tokens.push_back(5u, 9u);
+                tokens.push_back(15u, 9u);
+
+                auto last = session.registry();
+                for (std::size_t i = 0u; i < lookups; i++)
+                {
+                    session.refresh();
+                    if (session.registry() != last)
+                    {
+                        last = session.registry();
+                        refreshes++;
+                    }
+                    if (!session.find(tokens.begin(), tokens.end()))
+                        base_missing++;
+                    // touch whatever got found, so a freed snapshot would show up in the sanitizers.
+                    if (auto m = session.find(std::next(tokens.begin()), tokens.end()))
+                        plugins_found += static_cast<const ash::cmd*>(m.command)->help.size() > 0u;
+                    if (auto m = session.find(std::next(tokens.begin(), 2), tokens.end()))
+                        plugins_found += static_cast<const ash::cmd*>(m.command)->help.size() > 0u;
+                }
+            });
+    }
+
+    CHECK(base_missing == 0u);
+    CHECK(publisher->version() == updaters * updates * 3u);
+    // no update got lost.
+    const auto final = publisher->snapshot();
+    CHECK(final->commands().size() == 1u + updaters * updates);
+    const std::array<std::string_view, 1u> transient{"transient"};
+    CHECK(final->find(transient.begin(), transient.end()).first == nullptr);
+    // nobody holds the old snapshots anymore.
+    CHECK(first.expired());
+    MESSAGE(refreshes.load(), " snapshots picked up by ", dispatchers, " sessions, ", plugins_found.load(), " plugin lookups");
+}
@@ -0,0 +1,403 @@
+#include <doctest.h>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+#include <ash/reader.hpp>
+
+namespace net = ash::net;
+
+namespace
+{
+
+auto single_chunk(net::any_io_executor, std::string_view chunk, std::size_t & reads) -> ash::chunk_reader
+{
+    reads++;
+    co_yield chunk;
+    reads++;
+}
+
+auto count_lines(net::any_io_executor, ash::token_reader & reader, std::size_t & lines) -> net::experimental::coro<void>
+{
+    while (auto ln = co_await reader(ash::reader_mode{}))
+    {
+        CHECK(ln->tokens.size() == 2u);
+        lines++;
+    }
+}
+
+std::string pipelined_commands(std::size_t n)
+{
+    std::string res;
+    for (std::size_t i = 0u; i < n; i++)
+        res += "cmd " + std::to_string(i) + (i % 2 ? ";" : "\n");
+    return res;
+}
+
+}
+
+TEST_CASE("line_framer drains a chunk")
+{
+    const auto chunk = pipelined_commands(50u);
+    ash::line_framer framer;
+    ash::reader_mode mode;
+
+    framer.feed(chunk);
+    std::size_t lines = 0u;
+    while (auto ln = framer.next(mode))
+        lines++;
+
+    CHECK(lines == 50u);
+    CHECK(framer.empty());
+}
+
+TEST_CASE("line_framer scans a large quoted argument in linear time")
+{
+    // a framer restarting at the front of the buffer for every chunk would need ~13 GB of scanning here.
+    const std::string payload = "upload '" + std::string(10u * 1024u * 1024u, 'x') + "'\n";
+    ash::line_framer framer;
+    ash::reader_mode mode;
+
+    std::optional<ash::tokenized_view> line;
+    for (std::size_t pos = 0u; pos < payload.size() && !line; pos += 4096u)
+    {
+        framer.feed(std::string_view(payload).substr(pos, 4096u));
+        line = framer.next(mode);
+        framer.stash();
+    }
+
+    REQUIRE(line);
+    REQUIRE(line->tokens.size() == 2u);
+    CHECK(line->tokens[0] == "upload");
+    CHECK(line->tokens[1].size() == 10u * 1024u * 1024u);
+    CHECK(framer.empty());
+    // every byte up to the terminator once, the result alone can't tell.
+    CHECK(framer.bytes_scanned() == payload.size() - 1u);
+}
+
+TEST_CASE("line_framer finds a terminator split across chunks")
+{
+    ash::line_framer framer;
+    ash::reader_mode mode{ash::reader_mode::multiline_with_terminator_t{"EOI"}};
+
+    framer.feed("first\nsecond E");
+    CHECK(!framer.next(mode));
+    framer.stash();
+    framer.feed("O");
+    CHECK(!framer.next(mode));
+    framer.stash();
+    framer.feed("I\nrest");
+
+    auto ml = framer.next(mode);
+    REQUIRE(ml);
+    CHECK(ml->raw_input == "first\nsecond EOI");
+    CHECK(framer.data() == "rest");
+}
+
+TEST_CASE("line_framer checks each line once against the predicate")
+{
+    ash::line_framer framer;
+    std::size_t calls = 0u;
+    ash::reader_mode mode{ash::reader_mode::multiline_with_predicate_t{
+        [&](std::string_view sv)
+        {
+            calls++;
+            return sv.ends_with("}");
+        }}};
+
+    framer.feed("{\n");
+    CHECK(!framer.next(mode));
+    framer.stash();
+    framer.feed("  \"foo\" : 42\n");
+    CHECK(!framer.next(mode));
+    framer.stash();
+    framer.feed("}\n");
+
+    auto ml = framer.next(mode);
+    REQUIRE(ml);
+    CHECK(ml->raw_input == "{\n  \"foo\" : 42\n}");
+    CHECK(calls == 3u);
+}
+
+TEST_CASE("line_framer ends a line at a trailing comment")
+{
+    ash::line_framer framer;
+    ash::reader_mode mode;
+
+    // nothing more is coming, so the line needs to be complete at the line break.
+    framer.feed("status # check\n");
+    auto ln = framer.next(mode);
+    REQUIRE(ln);
+    CHECK(ln->tokens == std::vector<std::string_view>{"status"});
+    CHECK(framer.empty());
+
+    // a comment-only line is still skipped.
+    framer.feed("# just a comment\n");
+    CHECK(!framer.next(mode));
+    framer.stash();
+    framer.feed("cmd # c\n");
+    ln = framer.next(mode);
+    REQUIRE(ln);
+    CHECK(ln->tokens == std::vector<std::string_view>{"cmd"});
+}
+
+TEST_CASE("line_framer tells if the next line is complete")
+{
+    ash::line_framer framer;
+    ash::reader_mode mode;
+    const ash::reader_mode raw{ash::reader_mode::raw_line_t{}};
+
+    framer.feed("cmd\n ; \npartial");
+    REQUIRE(framer.next(mode));
+    // the empty statement doesn't count.
+    CHECK(!framer.has_line(mode));
+    CHECK(framer.has_line(raw));
+
+    framer.stash();
+    framer.feed(" line\n");
+    CHECK(framer.has_line(mode));
+    auto ln = framer.next(mode);
+    REQUIRE(ln);
+    CHECK(ln->raw_input == "partial line");
+
+    // next picks up the scan has_line did.
+    framer.feed("cmd arg\n");
+    CHECK(framer.has_line(mode));
+    const auto ahead = framer.bytes_scanned();
+    REQUIRE(framer.next(mode));
+    CHECK(framer.bytes_scanned() == ahead);
+}
+
+TEST_CASE("line_framer keeps a pinned line while the buffer grows")
+{
+    ash::line_framer framer;
+    ash::reader_mode pinned;
+    pinned.pin = true;
+    ash::reader_mode nested{ash::reader_mode::raw_line_t{}};
+
+    framer.feed("cmd 'first arg' second\npartial");
+    framer.stash();
+    auto ln = framer.next(pinned);
+    REQUIRE(ln);
+
+    // a nested read that forces the buffer into a new block.
+    const std::string big(64u * 1024u, 'x');
+    framer.feed(big + "\n");
+    REQUIRE(framer.next(nested));
+
+    CHECK(ln->raw_input == "cmd 'first arg' second");
+    CHECK(ln->tokens == std::vector<std::string_view>{"cmd", "first arg", "second"});
+}
+
+TEST_CASE("line_framer copies a pinned line out of the chunk")
+{
+    ash::line_framer framer;
+    ash::reader_mode pinned;
+    pinned.pin = true;
+
+    std::string chunk = "echo foo bar\nrest";
+    framer.feed(chunk);
+    auto ln = framer.next(pinned);
+    REQUIRE(ln);
+    framer.stash();
+    chunk.assign(chunk.size(), '?');
+
+    CHECK(ln->raw_input == "echo foo bar");
+    CHECK(ln->tokens == std::vector<std::string_view>{"echo", "foo", "bar"});
+    CHECK(framer.data() == "rest");
+}
+
+TEST_CASE("frame_buffer hands its storage back to the pool")
+{
+    ash::buffer_pool pool;
+    ash::frame_buffer buffer{4096u, pool};
+
+    buffer.append("echo foo\n");
+    CHECK(!buffer.release());
+    buffer.consume(buffer.size());
+    CHECK(buffer.release());
+    CHECK(pool.cached() == 4096u);
+
+    // the next session reuses the block.
+    ash::frame_buffer other{4096u, pool};
+    other.append(std::string(5000u, 'x'));
+    CHECK(other.capacity() == 8192u);
+    buffer.append("echo bar\n");
+    CHECK(pool.cached() == 0u);
+
+    // pinned bytes are kept, until the pin is gone.
+    buffer.pin(0u);
+    buffer.consume(buffer.size());
+    CHECK(!buffer.release());
+    buffer.unpin();
+    CHECK(buffer.release());
+}
+
+TEST_CASE("frame_pool recycles frames by size class")
+{
+    ash::frame_pool pool;
+
+    auto small = pool.allocate(100u);
+    pool.deallocate(small, 100u);
+    // same class, same block.
+    auto same = pool.allocate(120u);
+    auto other = pool.allocate(100u);
+    CHECK(same == small);
+    CHECK(other != small);
+    CHECK(pool.stats().reused == 1u);
+    pool.deallocate(same, 120u);
+    pool.deallocate(other, 100u);
+
+    auto big = pool.allocate(ash::frame_pool::max_frame_size + 1u);
+    pool.deallocate(big, ash::frame_pool::max_frame_size + 1u);
+    CHECK(pool.stats().sizes.back() == 1u);
+    CHECK(pool.stats().sizes[1u] == 3u);
+    CHECK(pool.stats().largest == ash::frame_pool::max_frame_size + 1u);
+    // frames allocated without a pool fit the class they're freed into.
+    static_assert(ash::frame_pool::block_size(100u) == 128u);
+    static_assert(ash::frame_pool::block_size(128u) == 128u);
+    static_assert(ash::frame_pool::block_size(ash::frame_pool::max_frame_size + 1u) == ash::frame_pool::max_frame_size + 1u);
+
+    ash::frame_allocator<int> alloc;
+    auto p = alloc.allocate(10u);
+    alloc.deallocate(p, 10u);
+    auto q = alloc.allocate(10u);
+    CHECK(q == p);
+    alloc.deallocate(q, 10u);
+}
+
+TEST_CASE("frame_pool of the thread outlives other pools")
+{
+    {
+        ash::frame_pool pool;
+        pool.deallocate(pool.allocate(100u), 100u);
+    }
+    auto local = ash::frame_pool::local();
+    REQUIRE(local != nullptr);
+    local->deallocate(local->allocate(100u), 100u);
+}
+
+TEST_CASE("read_size_policy adapts to the reads")
+{
+    ash::read_size_policy policy{4096u, 64u * 1024u};
+
+    // a bulk upload fills every read.
+    while (policy.size() < policy.max_size)
+        policy.update(policy.size(), policy.size());
+    CHECK(policy.stats.grown == 4u);
+    policy.update(policy.size(), policy.size());
+    CHECK(policy.size() == 64u * 1024u);
+
+    // an interactive session sends a line at a time.
+    while (policy.size() > policy.min_size)
+        policy.update(policy.size(), 10u);
+    CHECK(policy.stats.shrunk == 4u);
+    CHECK(policy.stats.largest == 64u * 1024u);
+    CHECK(policy.stats.reads == 9u);
+
+    // half a buffer is neither.
+    policy.update(policy.size(), policy.size() / 2u);
+    CHECK(policy.size() == 4096u);
+}
+
+TEST_CASE("read costs one chunk for pipelined commands")
+{
+    net::io_context ctx;
+    const auto chunk = pipelined_commands(50u);
+
+    std::size_t reads = 0u, lines = 0u;
+    auto reader = ash::read(single_chunk(ctx.get_executor(), chunk, reads));
+    auto task = count_lines(ctx.get_executor(), reader, lines);
+    task.async_resume(net::detached);
+    ctx.run();
+
+    CHECK(lines == 50u);
+    // one read for the chunk & one for the eof.
+    CHECK(reads == 2u);
+}
+
+#if defined(ASH_HAS_IO_URING)
+
+namespace
+{
+
+auto write_and_close(net::any_io_executor, ash::chunk_writer writer, net::local::stream_protocol::socket & sink)
+    -> net::experimental::coro<void>
+{
+    // the first resume writes the message the writer got constructed with.
+    co_await writer(std::string_view{});
+    // the writer keeps the socket open, the reader needs the eof.
+    sink.shutdown(net::socket_base::shutdown_send);
+}
+
+// MB/s of pipelined commands read through `make_reader` from a tcp loopback connection.
+template<typename MakeReader>
+double loopback_throughput(MakeReader make_reader)
+{
+    net::io_context ctx;
+    net::ip::tcp::acceptor acceptor{ctx, {net::ip::address_v4::loopback(), 0}};
+    net::ip::tcp::socket sink{ctx}, source{ctx};
+    sink.connect(acceptor.local_endpoint());
+    acceptor.accept(source);
+
+    constexpr std::size_t line_count = 1000000u;
+    const auto payload = pipelined_commands(line_count);
+    std::size_t lines = 0u;
+    const auto start = std::chrono::steady_clock::now();
+    std::jthread writer{[&]
+                        {
+                            net::write(sink, net::buffer(payload));
+                            sink.shutdown(net::socket_base::shutdown_send);
+                        }};
+    ash::token_reader reader = make_reader(std::move(source));
+    auto task = count_lines(ctx.get_executor(), reader, lines);
+    // the epoll reader ends with an eof error, the uring one without.
+    task.async_resume([&](std::exception_ptr) {ctx.stop();});
+    ctx.run();
+    const auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    CHECK(lines == line_count);
+    return static_cast<double>(payload.size()) / elapsed / 1e6;
+}
+
+auto collect_lines(net::any_io_executor, ash::token_reader reader, std::vector<std::string> & lines)
+    -> net::experimental::coro<void>
+{
+    while (auto ln = co_await reader(ash::reader_mode{ash::reader_mode::raw_line_t{}}))
+        lines.emplace_back(ln->raw_input);
+}
+
+}
+
+TEST_CASE("uring_stream_reader reads what uring_stream_writer wrote")
+{
+    net::io_context ctx;
+    net::local::stream_protocol::socket sink{ctx}, source{ctx};
+    net::local::connect_pair(sink, source);
+
+    // spans a few of the ring's buffers.
+    std::string payload;
+    for (std::size_t i = 0u; i < 2000u; i++)
+        payload += "line " + std::to_string(i) + "\n";
+
+    std::vector<std::string> lines;
+    auto writer = write_and_close(ctx.get_executor(),
+                                  ash::uring_stream_writer<net::local::stream_protocol::socket &>(sink, payload), sink);
+    auto reader = collect_lines(ctx.get_executor(), ash::read(ash::uring_stream_reader(std::move(source))), lines);
+    writer.async_resume(net::detached);
+    reader.async_resume(net::detached);
+    ctx.run();
+
+    REQUIRE(lines.size() == 2000u);
+    CHECK(lines.front() == "line 0");
+    CHECK(lines.back() == "line 1999");
+}
+
+TEST_CASE("uring_stream_reader throughput against stream_reader on loopback")
+{
+    const auto epoll = loopback_throughput([](net::ip::tcp::socket sock) {return ash::read(ash::stream_reader(std::move(sock)));});
+    const auto uring = loopback_throughput([](net::ip::tcp::socket sock) {return ash::read(ash::uring_stream_reader(std::move(sock)));});
+    MESSAGE("reading pipelined commands over tcp loopback; stream_reader: ", epoll, " MB/s, uring_stream_reader: ", uring, " MB/s");
+}
+
+#endif
@@ -0,0 +1,124 @@
+#ifndef ASH_TEST_SERVE_HPP
+#define ASH_TEST_SERVE_HPP
+
+#include <doctest.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
+#include <sys/resource.h>
+#include <ash/server.hpp>
+
+// clients pinging a server in the same process, shared by the server tests & benchmarks.
+namespace serve_test
+{
+
+namespace net = ash::net;
+
+inline constexpr std::size_t commands_per_client = 10u;
+
+// both ends of every connection live in this process.
+inline std::size_t max_clients()
+{
+    rlimit lim{};
+    if (::getrlimit(RLIMIT_NOFILE, &lim) != 0)
+        return 64u;
+    lim.rlim_cur = lim.rlim_max;
+    ::setrlimit(RLIMIT_NOFILE, &lim);
+    ::getrlimit(RLIMIT_NOFILE, &lim);
+    return std::clamp<std::size_t>((lim.rlim_cur - 128u) / 2u, 64u, 10000u);
+}
+
+template<typename Socket>
+auto read_prompt(net::any_io_executor, Socket & sock, std::string & buf)
+    -> net::experimental::coro<void, void, net::any_io_executor>
+{
+    buf.clear();
+    char chunk[256];
+    while (!buf.ends_with("ash> "))
+    {
+        auto n = co_await sock.async_read_some(net::buffer(chunk), net::experimental::use_coro);
+        buf.append(chunk, n);
+    }
+}
+
+struct load_result
+{
+    double commands_per_second;
+    double p50_us;
+    double p99_us;
+};
+
+template<typename Endpoint>
+auto client(net::any_io_executor exec, Endpoint ep, std::atomic<std::size_t> & pongs,
+            std::vector<double> & latencies) -> net::experimental::coro<void, void, net::any_io_executor>
+{
+    typename Endpoint::protocol_type::socket sock{exec};
+    co_await sock.async_connect(ep, net::experimental::use_coro);
+    if constexpr (std::is_same_v<typename Endpoint::protocol_type, net::ip::tcp>)
+        sock.set_option(net::ip::tcp::no_delay(true));
+
+    std::string buf;
+    co_await read_prompt(exec, sock, buf);
+    for (std::size_t i = 0u; i < commands_per_client; i++)
+    {
+        const auto start = std::chrono::steady_clock::now();
+        co_await net::async_write(sock, net::buffer(std::string_view{"ping\n"}), net::experimental::use_coro);
+        co_await read_prompt(exec, sock, buf);
+        latencies.push_back(std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count());
+        if (buf == "pong\nash> ")
+            pongs++;
+    }
+    co_await net::async_write(sock, net::buffer(std::string_view{"exit\n"}), net::experimental::use_coro);
+}
+
+// clients sessions pinging a Server running on threads.
+template<typename Server>
+load_result serve(std::size_t threads, std::size_t clients,
+                  typename Server::endpoint_type endpoint = {net::ip::address_v4::loopback(), 0})
+{
+    Server srv{{ash::cmd{.name = "ping",
+                         .run = [](ash::context ctx) -> ash::cmd_task {co_await ctx.write("pong\n");}}},
+               endpoint,
+               {.threads = threads, .max_sessions = clients}};
+    std::jthread server_thread{[&] {srv.run();}};
+
+    const auto client_threads = (std::max)(std::thread::hardware_concurrency(), 1u);
+    net::io_context ctx{static_cast<int>(client_threads)};
+    std::atomic<std::size_t> pongs{0u};
+    std::vector<std::vector<double>> latencies(clients);
+    std::vector<net::experimental::coro<void, void, net::any_io_executor>> tasks;
+    tasks.reserve(clients);
+
+    const auto start = std::chrono::steady_clock::now();
+    for (std::size_t i = 0u; i < clients; i++)
+    {
+        latencies[i].reserve(commands_per_client);
+        tasks.push_back(client(net::make_strand(ctx), srv.local_endpoint(), pongs, latencies[i]));
+        tasks.back().async_resume(net::detached);
+    }
+    {
+        std::vector<std::jthread> client_runners;
+        for (std::size_t i = 1u; i < client_threads; i++)
+            client_runners.emplace_back([&] {ctx.run();});
+        ctx.run();
+    }
+    const auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    srv.stop();
+    CHECK(pongs == clients * commands_per_client);
+
+    std::vector<double> all;
+    for (auto & l : latencies)
+        all.insert(all.end(), l.begin(), l.end());
+    std::sort(all.begin(), all.end());
+    REQUIRE(!all.empty());
+    return {static_cast<double>(pongs.load()) / elapsed, all[all.size() / 2u], all[all.size() * 99u / 100u]};
+}
+
+}
+
+#endif //ASH_TEST_SERVE_HPP
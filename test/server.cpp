@@ -0,0 +1,108 @@
+#include <doctest.h>
+#include <algorithm>
+#include <chrono>
+#include <set>
+#include <string>
+#include <thread>
+#include <fcntl.h>
+#include <sys/resource.h>
+#include <unistd.h>
+#include <ash/server.hpp>
+#include "serve.hpp"
+
+namespace net = ash::net;
+using serve_test::serve;
+
+// the full run with as many clients as there are fds for is in bench_test.
+TEST_CASE("server throughput scales with threads")
+{
+    const auto cores = (std::max)(std::thread::hardware_concurrency(), 1u);
+    constexpr std::size_t clients = 64u;
+
+    std::set<std::size_t> thread_counts{1u, (std::min)(2u, cores), (std::min)(4u, cores), cores};
+    for (auto threads : thread_counts)
+        MESSAGE(clients, " sessions on ", threads, " threads: ",
+                serve<ash::server>(threads, clients).commands_per_second, " commands/s");
+}
+
+TEST_CASE("sharded_server latency against a shared io_context")
+{
+    const auto cores = (std::max)(std::thread::hardware_concurrency(), 1u);
+    constexpr std::size_t clients = 64u;
+
+    const auto shared = serve<ash::server>(cores, clients);
+    const auto sharded = serve<ash::sharded_server>(cores, clients);
+    MESSAGE(clients, " clients, ", cores, " threads; shared: p50 ", shared.p50_us, "us, p99 ", shared.p99_us, "us, ",
+            shared.commands_per_second, " commands/s; sharded: p50 ", sharded.p50_us, "us, p99 ", sharded.p99_us, "us, ",
+            sharded.commands_per_second, " commands/s");
+}
+
+TEST_CASE("unix domain socket latency against tcp loopback")
+{
+    constexpr std::size_t clients = 64u;
+    const auto name = "ash-test-" + std::to_string(::getpid());
+
+    const auto tcp = serve<ash::server>(1u, clients);
+    const auto local = serve<ash::local_server>(1u, clients, ash::abstract_endpoint(name));
+    MESSAGE("ping over tcp loopback: p50 ", tcp.p50_us, "us, p99 ", tcp.p99_us, "us; over an abstract unix socket: p50 ",
+            local.p50_us, "us, p99 ", local.p99_us, "us");
+}
+
+TEST_CASE("server backs off while it's out of file descriptors & recovers")
+{
+    ash::server srv{{ash::cmd{.name = "ping",
+                              .run = [](ash::context ctx) -> ash::cmd_task {co_await ctx.write("pong\n");}}},
+                    {net::ip::address_v4::loopback(), 0},
+                    {.threads = 1u}};
+    net::io_context ctx;
+    net::ip::tcp::socket sock{ctx};
+    sock.open(net::ip::tcp::v4());
+
+    // fds get allocated lowest first, so with the limit at the lowest free one the server can't accept.
+    rlimit original{};
+    REQUIRE(::getrlimit(RLIMIT_NOFILE, &original) == 0);
+    const auto lowest_free = ::open("/dev/null", O_RDONLY);
+    REQUIRE(lowest_free >= 0);
+    ::close(lowest_free);
+    auto exhausted = original;
+    exhausted.rlim_cur = static_cast<rlim_t>(lowest_free);
+    REQUIRE(::setrlimit(RLIMIT_NOFILE, &exhausted) == 0);
+
+    std::jthread server_thread{[&] {srv.run();}};
+    // also when a REQUIRE throws, before the server thread gets joined.
+    struct restore
+    {
+        ash::server & srv;
+        rlimit limit;
+        ~restore()
+        {
+            ::setrlimit(RLIMIT_NOFILE, &limit);
+            srv.stop();
+        }
+    } guard{srv, original};
+    sock.connect(srv.local_endpoint());
+
+    const auto cpu_time = []
+    {
+        rusage ru{};
+        ::getrusage(RUSAGE_SELF, &ru);
+        return std::chrono::seconds(ru.ru_utime.tv_sec + ru.ru_stime.tv_sec)
+             + std::chrono::microseconds(ru.ru_utime.tv_usec + ru.ru_stime.tv_usec);
+    };
+    const auto before = cpu_time();
+    std::this_thread::sleep_for(std::chrono::milliseconds(300));
+    const auto spent = cpu_time() - before;
+    ::setrlimit(RLIMIT_NOFILE, &original);
+
+    // a loop retrying the accept right away would burn the whole time.
+    CHECK(spent < std::chrono::milliseconds(100));
+
+    // the connection waited in the backlog & gets served once there are fds again.
+    net::write(sock, net::buffer(std::string_view{"ping\nexit\n"}));
+    std::string received;
+    std::error_code ec;
+    char chunk[256];
+    while (!ec)
+        received.append(chunk, sock.read_some(net::buffer(chunk), ec));
+    CHECK(received == "ash> pong\nash> ");
+}
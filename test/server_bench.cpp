@@ -0,0 +1,16 @@
+#include <doctest.h>
+#include <algorithm>
+#include <set>
+#include <thread>
+#include "serve.hpp"
+
+TEST_CASE("server throughput scales with threads")
+{
+    const auto cores = (std::max)(std::thread::hardware_concurrency(), 1u);
+    const auto clients = serve_test::max_clients();
+
+    std::set<std::size_t> thread_counts{1u, (std::min)(2u, cores), (std::min)(4u, cores), cores};
+    for (auto threads : thread_counts)
+        MESSAGE(clients, " sessions on ", threads, " threads: ",
+                serve_test::serve<ash::server>(threads, clients).commands_per_second, " commands/s");
+}
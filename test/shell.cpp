@@ -0,0 +1,269 @@
+#include <doctest.h>
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+#include <unistd.h>
+#include <ash/shell.hpp>
+
+namespace net = ash::net;
+
+namespace
+{
+
+auto script_reader(net::any_io_executor, std::string_view script) -> ash::chunk_reader
+{
+    co_yield script;
+}
+
+// hands out the chunks one by one, noting how many writes happened before each of them.
+auto chunked_reader(net::any_io_executor, std::vector<std::string_view> chunks,
+                    const std::vector<std::string> & writes, std::vector<std::size_t> & writes_before) -> ash::chunk_reader
+{
+    for (auto chunk : chunks)
+    {
+        writes_before.push_back(writes.size());
+        co_yield chunk;
+    }
+}
+
+auto recording_writer(net::any_io_executor, std::vector<std::string> & writes, std::string_view msg = "") -> ash::chunk_writer
+{
+    while (true)
+    {
+        if (!msg.empty())
+            writes.emplace_back(msg);
+        msg = co_yield msg.size();
+    }
+}
+
+auto rows(ash::context ctx) -> ash::cmd_task
+{
+    for (int i = 0; i < 200; i++)
+        co_await ctx.write("row " + std::to_string(i) + "\n");
+}
+
+std::vector<std::string> run_script(std::string_view script, const ash::shell_options & options = {})
+{
+    net::io_context ctx;
+    std::vector<std::string> writes;
+    ash::shell sh{script_reader(ctx.get_executor(), script),
+                  recording_writer(ctx.get_executor(), writes),
+                  {ash::cmd{.name = "rows", .run = rows},
+                   ash::cmd{.name = "gather",
+                            .run = [](ash::context ctx) -> ash::cmd_task
+                            {
+                                const std::array parts{net::buffer(ctx.args.front()), net::buffer(std::string_view{" & "}),
+                                                       net::buffer(ctx.args.back()), net::buffer(std::string_view{"\n"})};
+                                co_await ctx.write(parts);
+                            }},
+#if defined(__cpp_lib_format)
+                   ash::cmd{.name = "sum",
+                            .run = [](ash::context ctx) -> ash::cmd_task
+                            {
+                                co_await ctx.print("{} + {} = {}\n", ctx.args[0], ctx.args[1],
+                                                   std::stoi(std::string(ctx.args[0])) + std::stoi(std::string(ctx.args[1])));
+                            }},
+#endif
+                   ash::cmd{.name = "ask",
+                            .run = [](ash::context ctx) -> ash::cmd_task
+                            {
+                                co_await ctx.write("name? ");
+                                auto name = co_await ctx.read_line();
+                                co_await ctx.write("hi " + std::string(name) + "\n");
+                            }}},
+                  "ash", options};
+    sh.async_run(net::detached);
+    ctx.run();
+    return writes;
+}
+
+}
+
+TEST_CASE("shell writes a command's output together with the next prompt")
+{
+    const auto writes = run_script("rows\nrows\n");
+
+    REQUIRE(writes.size() == 3u);
+    CHECK(writes[0] == "ash> ");
+    for (auto & w : {writes[1], writes[2]})
+    {
+        CHECK(w.starts_with("row 0\n"));
+        CHECK(w.ends_with("row 199\nash> "));
+        CHECK(std::count(w.begin(), w.end(), '\n') == 200);
+    }
+}
+
+TEST_CASE("shell flushes its output before reading input")
+{
+    const auto writes = run_script("ask\nbob\n");
+
+    REQUIRE(writes.size() == 3u);
+    CHECK(writes[1] == "name? ");
+    CHECK(writes[2] == "hi bob\nash> ");
+}
+
+TEST_CASE("shell gathers buffer sequences")
+{
+    const auto writes = run_script("gather foo bar\n");
+
+    REQUIRE(writes.size() == 2u);
+    CHECK(writes[1] == "foo & bar\nash> ");
+}
+
+#if defined(__cpp_lib_format)
+TEST_CASE("shell formats into the output")
+{
+    const auto writes = run_script("sum 2 40\n");
+
+    REQUIRE(writes.size() == 2u);
+    CHECK(writes[1] == "2 + 40 = 42\nash> ");
+}
+#endif
+
+TEST_CASE("shell flushes its output at the threshold")
+{
+    ash::shell_options options;
+    options.flush_threshold = 1024u;
+    const auto writes = run_script("rows\n", options);
+
+    REQUIRE(writes.size() == 3u);
+    CHECK(writes[1].size() >= 1024u);
+    CHECK(writes[1].size() < 1024u + 8u);
+    CHECK(writes[2].ends_with("row 199\nash> "));
+}
+
+TEST_CASE("shell in batch mode writes no prompts and only flushes when it's done")
+{
+    ash::shell_options options;
+    options.mode = ash::shell_mode::batch;
+    const auto writes = run_script("rows\nask\nbob\nrows\n", options);
+
+    REQUIRE(writes.size() == 1u);
+    CHECK(writes[0].find("ash>") == std::string::npos);
+    CHECK(writes[0].find("name? hi bob\nrow 0\n") != std::string::npos);
+    CHECK(std::count(writes[0].begin(), writes[0].end(), '\n') == 401);
+}
+
+TEST_CASE("shell in batch mode flushes before waiting for input")
+{
+    net::io_context ctx;
+    std::vector<std::string> writes;
+    std::vector<std::size_t> writes_before;
+    ash::shell sh{chunked_reader(ctx.get_executor(), {"rows\nrows\n", "rows # last\n"}, writes, writes_before),
+                  recording_writer(ctx.get_executor(), writes),
+                  {ash::cmd{.name = "rows", .run = rows}},
+                  "ash", {.mode = ash::shell_mode::batch}};
+    sh.async_run(net::detached);
+    ctx.run();
+
+    // e.g. a peer on a pipe, that waits for the replies before it sends more.
+    CHECK(writes_before == std::vector<std::size_t>{0u, 1u});
+    REQUIRE(writes.size() == 2u);
+    CHECK(std::count(writes[0].begin(), writes[0].end(), '\n') == 400);
+    CHECK(std::count(writes[1].begin(), writes[1].end(), '\n') == 200);
+}
+
+TEST_CASE("shell picks up published commands at the next command")
+{
+    net::io_context ctx;
+    std::vector<std::string> writes;
+    auto publisher = std::make_shared<ash::command_publisher>();
+    publisher->add({.name = "load",
+                    .run = [&](ash::context ctx) -> ash::cmd_task
+                    {
+                        publisher->add({.name = "plugin",
+                                        .run = [](ash::context ctx) -> ash::cmd_task {co_await ctx.write("plugin\n");}});
+                        co_await ctx.write("loaded\n");
+                    }});
+
+    ash::shell sh{script_reader(ctx.get_executor(), "plugin\nload\nplugin\n"),
+                  recording_writer(ctx.get_executor(), writes),
+                  publisher, "ash", {.mode = ash::shell_mode::batch}};
+    sh.async_run(net::detached);
+    ctx.run();
+
+    REQUIRE(writes.size() == 1u);
+    CHECK(writes[0] == "command not found\nloaded\nplugin\n");
+}
+
+TEST_CASE("shell on a unix domain socket knows its peer")
+{
+    net::io_context ctx;
+    net::local::stream_protocol::socket server_end{ctx}, client_end{ctx};
+    net::local::connect_pair(server_end, client_end);
+
+    std::optional<ash::peer_credentials> peer;
+    ash::shell sh{server_end,
+                  {ash::cmd{.name = "whoami",
+                            .run = [&](ash::context ctx) -> ash::cmd_task
+                            {
+                                peer = ctx.peer_credentials();
+                                co_await ctx.write("done\n");
+                            }}}};
+    sh.async_run(net::detached);
+
+    const std::string_view script = "whoami\nexit\n";
+    net::write(client_end, net::buffer(script));
+    ctx.run();
+
+    REQUIRE(peer);
+    CHECK(peer->pid == ::getpid());
+    CHECK(peer->uid == ::getuid());
+    CHECK(peer->gid == ::getgid());
+}
+
+TEST_CASE("shell runs synchronous commands inline")
+{
+    net::io_context ctx;
+    std::vector<std::string> writes;
+    ash::shell sh{script_reader(ctx.get_executor(), "get\nstatus up\nrows\nget\n"),
+                  recording_writer(ctx.get_executor(), writes),
+                  {ash::cmd{.name = "get", .run = [](ash::context & ctx) {ctx.output() += "value\n";}},
+                   ash::cmd{.name = "status",
+                            .run = [](ash::context & ctx) {return "status " + std::string(ctx.args.front()) + "\n";}},
+                   ash::cmd{.name = "rows", .run = rows}},
+                  "ash", {.mode = ash::shell_mode::batch}};
+    sh.async_run(net::detached);
+    ctx.run();
+
+    std::string all;
+    for (auto & w : writes)
+        all += w;
+    CHECK(all.starts_with("value\nstatus up\nrow 0\n"));
+    CHECK(all.ends_with("row 199\nvalue\n"));
+}
+
+TEST_CASE("synchronous commands against coroutines")
+{
+    constexpr std::size_t commands = 100000u;
+    std::string script;
+    for (std::size_t i = 0u; i < commands; i++)
+        script += "ping\n";
+
+    const auto run = [&](ash::cmd cmd)
+    {
+        net::io_context ctx;
+        std::vector<std::string> writes;
+        ash::shell sh{script_reader(ctx.get_executor(), script),
+                      recording_writer(ctx.get_executor(), writes),
+                      {std::move(cmd)}, "ash", {.mode = ash::shell_mode::batch}};
+        const auto start = std::chrono::steady_clock::now();
+        sh.async_run(net::detached);
+        ctx.run();
+        const auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        std::size_t written = 0u;
+        for (auto & w : writes)
+            written += w.size();
+        CHECK(written == commands * 5u);
+        return static_cast<double>(commands) / elapsed;
+    };
+
+    const auto async = run({.name = "ping", .run = [](ash::context ctx) -> ash::cmd_task {co_await ctx.write("pong\n");}});
+    const auto sync = run({.name = "ping", .run = [](ash::context & ctx) {ctx.output() += "pong\n";}});
+    MESSAGE("trivial commands: ", async, " ops/s as coroutines, ", sync, " ops/s synchronous");
+}
@@ -1,6 +1,7 @@
 #include <doctest.h>
 #include <string_view>
 #include <iostream>
+#include <string>
 #include <ash/tokenizer.hpp>
 
 TEST_CASE("line_matcher")
@@ -80,3 +81,127 @@ broken)");
     CHECK(tks.tokens == std::vector<std::string_view>{"asd"});
     CHECK(rest == "");
 }
+
+TEST_CASE("line_tokenizer")
+{
+    constexpr std::string_view raw = R"(  set x#1 'a b' "c\"";rest)";
+
+    ash::line_tokenizer tk;
+    std::vector<ash::token_span> spans;
+    const auto end = tk.scan(raw, [&](ash::token_span sp) {spans.push_back(sp);});
+
+    REQUIRE(end == raw.find(';'));
+    CHECK(raw.substr(tk.begin, end - tk.begin) == R"(set x#1 'a b' "c\"")");
+    REQUIRE(spans.size() == 4u);
+    CHECK(raw.substr(spans[0].offset, spans[0].length) == "set");
+    CHECK(raw.substr(spans[1].offset, spans[1].length) == "x#1");
+    CHECK(raw.substr(spans[2].offset, spans[2].length) == "a b");
+    CHECK(spans[2].kind == ash::token_kind::single_quoted);
+    CHECK(raw.substr(spans[3].offset, spans[3].length) == R"(c\")");
+    CHECK(spans[3].kind == ash::token_kind::double_quoted);
+
+    auto [tks, rest] = ash::tokenize(raw);
+    CHECK(tks.tokens.size() == 4u);
+    CHECK(rest == "rest");
+
+    tie(tks, rest) = ash::tokenize(R"(foo "unterminated)");
+    CHECK(tks.tokens == std::vector<std::string_view>{"foo"});
+    CHECK(rest == R"("unterminated)");
+}
+
+namespace
+{
+
+std::string mixed_input(std::size_t n, unsigned seed)
+{
+    constexpr std::string_view alphabet = "ab \t\n;\"'\\#\r\v\f";
+    std::string res;
+    for (std::size_t i = 0u; i < n; i++)
+    {
+        seed = seed * 1103515245u + 12345u;
+        res += alphabet[(seed >> 16u) % alphabet.size()];
+    }
+    return res;
+}
+
+// every line followed by its tokens, when the data arrives in chunks of `step` bytes.
+std::vector<std::vector<std::string_view>> all_lines(std::string_view data, std::size_t step)
+{
+    std::vector<std::vector<std::string_view>> res;
+    std::vector<ash::token_span> spans;
+    ash::line_tokenizer tk;
+    std::size_t offset = 0u, available = 0u;
+    while (available < data.size())
+    {
+        available = (std::min)(available + step, data.size());
+        while (true)
+        {
+            const auto window = data.substr(offset, available - offset);
+            const auto end = tk.scan(window, [&](ash::token_span sp) {spans.push_back(sp);});
+            if (end == std::string_view::npos)
+                break;
+
+            auto & ln = res.emplace_back();
+            ln.push_back(window.substr(tk.begin, end - tk.begin));
+            for (const auto & sp : spans)
+                ln.push_back(window.substr(sp.offset, sp.length));
+            spans.clear();
+            tk.reset();
+            offset += end + 1u;
+        }
+    }
+    return res;
+}
+
+}
+
+TEST_CASE("structural masks")
+{
+    const auto input = mixed_input(4096u, 42u);
+    for (std::size_t pos = 0u; pos < input.size(); pos += 7u)
+    {
+        const auto n = (std::min)(std::size_t{64u}, input.size() - pos);
+        const auto simd = ash::classify(input.data() + pos, n);
+        const auto scalar = ash::detail::classify_scalar(input.data() + pos, n);
+        CHECK(simd.line_break   == scalar.line_break);
+        CHECK(simd.semi_colon   == scalar.semi_colon);
+        CHECK(simd.double_quote == scalar.double_quote);
+        CHECK(simd.single_quote == scalar.single_quote);
+        CHECK(simd.backslash    == scalar.backslash);
+        CHECK(simd.hash         == scalar.hash);
+        CHECK(simd.space        == scalar.space);
+        CHECK(simd.valid        == scalar.valid);
+    }
+}
+
+TEST_CASE("line_tokenizer does not depend on chunking")
+{
+    std::string log;
+    for (int i = 0; i < 200; i++)
+        log += "set metric.value" + std::to_string(i) + " 42; get 'quoted value' \"with \\\" escape\" # comment\n";
+
+    for (const auto & input : {log, mixed_input(8192u, 7u)})
+    {
+        const auto whole = all_lines(input, input.size());
+        CHECK(all_lines(input, 1u) == whole);
+        CHECK(all_lines(input, 63u) == whole);
+        CHECK(all_lines(input, 4096u) == whole);
+    }
+}
+
+TEST_CASE("token_list")
+{
+    std::string line;
+    for (int i = 0; i < 20; i++)
+        line += (i % 2 ? "'tk" : "\"tk") + std::to_string(i) + (i % 2 ? "' " : "\" ");
+
+    auto [tks, rest] = ash::tokenize(line);
+    REQUIRE(tks.tokens.size() == 20u);
+    for (std::size_t i = 0u; i < tks.tokens.size(); i++)
+    {
+        CHECK(tks.tokens[i] == "tk" + std::to_string(i));
+        CHECK(tks.tokens.kind(i) == (i % 2 ? ash::token_kind::single_quoted : ash::token_kind::double_quoted));
+    }
+    CHECK(*std::next(tks.tokens.begin(), 17) == "tk17");
+    CHECK(tks.tokens.back() == "tk19");
+}